@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "node.h"
+#include "codegen.h"
+#include "utils/sink.h"
+
+/*
+ * Compile a program held in memory into Whitespace, writing the code to the
+ * sink. optimize is the -O level and jobs the number of functions generated
+ * in parallel. Diagnostics are printed to standard error. Returns the number
+ * of errors.
+ */
+int akarin_compile(const char *src, size_t len, int optimize, int jobs, sink_t *sink);
+
+/*
+ * Generate code for a parsed program: with optimize > 0 the tree is folded
+ * first and the code goes through the CFG, peephole and relabel passes.
+ * verbose adds the statistics of each pass to the diagnostics written to
+ * messages. The caller checks the error count and releases the codegen.
+ */
+codegen_t *akarin_generate(node_t *node, int optimize, int jobs, bool verbose, sink_t *messages);
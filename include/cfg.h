@@ -0,0 +1,20 @@
+#pragma once
+
+#include "inst.h"
+
+/*
+ * A control-flow graph over generated code: basic blocks that start at a
+ * label or after a jump and end at JMP, JZ, JNEG, RET, HALT or before the
+ * next label. Each block knows its successors and its stack effect.
+ * Lowering writes the blocks back as instructions in their new order.
+ */
+typedef struct cfg_t cfg_t;
+
+cfg_t *cfg_new(insts_t *instructions);
+void   cfg_release(cfg_t **pcfg);
+bool   cfg_is_valid(cfg_t *cfg);
+void   cfg_thread_jumps(cfg_t *cfg);
+void   cfg_layout(cfg_t *cfg);
+void   cfg_lower(cfg_t *cfg, insts_t *instructions);
+
+int    cfg_optimize(insts_t *instructions);
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "node.h"
-#include "utils/array.h"
+#include "inst.h"
+#include "utils/sink.h"
 
 typedef struct codegen_t codegen_t;
 
-codegen_t *codegen_new(node_t *root);
+codegen_t *codegen_new(node_t *root, int jobs, int optimize);
 void       codegen_release(codegen_t **pcodegen);
+void       codegen_set_messages(codegen_t *codegen, sink_t *messages);
 void       codegen_generate(codegen_t *codegen);
 int        codegen_get_error_count(codegen_t *codegen);
-array_t   *codegen_get_instructions(codegen_t *codegen);
+insts_t   *codegen_get_instructions(codegen_t *codegen);
@@ -1,14 +1,18 @@
 #pragma once
 
 #include "inst.h"
-#include "utils/array.h"
+#include "utils/sink.h"
+#include "utils/writer.h"
 
 typedef struct emitter_t emitter_t;
 
+/* writer is valid between begin and end */
 struct emitter_t {
-  void (*emit)(emitter_t *self, inst_t *inst);
-  void (*end)(emitter_t *self);
+  void     (*begin)(emitter_t *self);
+  void     (*emit)(emitter_t *self, inst_t *inst);
+  void     (*end)(emitter_t *self);
+  writer_t  *writer;
 };
 
 void emitter_release(emitter_t **pemitter);
-void emitter_emit_code(emitter_t *emitter, array_t *instructions);
+void emitter_emit_code(emitter_t *emitter, insts_t *instructions, sink_t *sink);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "emitter.h"
+
+emitter_t *emitter_c_new(void);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "node.h"
+
+int fold_optimize(node_t *root);
@@ -1,40 +1,59 @@
 #pragma once
 
+#include <stdbool.h>
 #include "opcode.h"
-#include "label.h"
 
+/*
+ * Instructions are plain values. A jump, call or label refers to its label
+ * by id; once code generation is done the id is the unified one.
+ */
 typedef struct {
   opcode_t opcode;
   union {
-    int      value;
-    label_t *label;
+    int value;
+    int label;
   };
 } inst_t;
 
-inst_t *inst_new_nop(void);
-inst_t *inst_new_push(int value);
-inst_t *inst_new_copy(int value);
-inst_t *inst_new_slide(int value);
-inst_t *inst_new_dup(void);
-inst_t *inst_new_pop(void);
-inst_t *inst_new_swap(void);
-inst_t *inst_new_add(void);
-inst_t *inst_new_sub(void);
-inst_t *inst_new_mul(void);
-inst_t *inst_new_div(void);
-inst_t *inst_new_mod(void);
-inst_t *inst_new_store(void);
-inst_t *inst_new_load(void);
-inst_t *inst_new_putc(void);
-inst_t *inst_new_puti(void);
-inst_t *inst_new_getc(void);
-inst_t *inst_new_geti(void);
-inst_t *inst_new_label(label_t *label);
-inst_t *inst_new_call(label_t *label);
-inst_t *inst_new_jmp(label_t *label);
-inst_t *inst_new_jz(label_t *label);
-inst_t *inst_new_jneg(label_t *label);
-inst_t *inst_new_ret(void);
-inst_t *inst_new_halt(void);
+inst_t inst_nop(void);
+inst_t inst_push(int value);
+inst_t inst_copy(int value);
+inst_t inst_slide(int value);
+inst_t inst_dup(void);
+inst_t inst_pop(void);
+inst_t inst_swap(void);
+inst_t inst_add(void);
+inst_t inst_sub(void);
+inst_t inst_mul(void);
+inst_t inst_div(void);
+inst_t inst_mod(void);
+inst_t inst_store(void);
+inst_t inst_load(void);
+inst_t inst_putc(void);
+inst_t inst_puti(void);
+inst_t inst_getc(void);
+inst_t inst_geti(void);
+inst_t inst_label(int label);
+inst_t inst_call(int label);
+inst_t inst_jmp(int label);
+inst_t inst_jz(int label);
+inst_t inst_jneg(int label);
+inst_t inst_ret(void);
+inst_t inst_halt(void);
 
-void    inst_release(inst_t **pinst);
+bool   inst_has_label(const inst_t *inst);
+
+/*
+ * A growable array of instructions stored by value, so the passes over the
+ * code walk one contiguous block. Pointers returned by insts_get and
+ * insts_data are invalidated by insts_append.
+ */
+typedef struct insts_t insts_t;
+
+insts_t *insts_new(int initial_capacity);
+void     insts_release(insts_t **pinsts);
+void     insts_append(insts_t *insts, inst_t inst);
+int      insts_count(insts_t *insts);
+inst_t  *insts_get(insts_t *insts, int index);
+inst_t  *insts_data(insts_t *insts);
+void     insts_truncate(insts_t *insts, int count);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include "inst.h"
+
+typedef struct jit_t jit_t;
+
+bool   jit_is_available(void);
+jit_t *jit_new(insts_t *instructions);
+void   jit_release(jit_t **pjit);
+void   jit_run(jit_t *jit);
+int    jit_get_error_count(jit_t *jit);
@@ -1,14 +1,18 @@
 #pragma once
 
-typedef struct label_t label_t;
+#define LABEL_NONE ( -1 )
+
+/*
+ * Labels are integer ids handed out by a table. Labels marking the same
+ * place can be unified; ltable_find gives the id standing for all of them.
+ */
 typedef struct ltable_t ltable_t;
 
 ltable_t *ltable_new(void);
+ltable_t *ltable_new_after(ltable_t *ltable);
 void      ltable_release(ltable_t **pltable);
-label_t  *ltable_alloc(ltable_t *ltable);
-label_t  *ltable_get(ltable_t *ltable, int id);
+int       ltable_alloc(ltable_t *ltable);
 int       ltable_count(ltable_t *ltable);
-
-void label_unify(label_t *label1, label_t *label2);
-int  label_get_id(label_t *label);
-int  label_get_unified_id(label_t *label);
+int       ltable_append(ltable_t *ltable, ltable_t *other);
+void      ltable_unify(ltable_t *ltable, int label1, int label2);
+int       ltable_find(ltable_t *ltable, int label);
@@ -1,11 +1,12 @@
 #pragma once
 
+#include <stddef.h>
 #include "ttype.h"
 #include "location.h"
 
 typedef struct lexer_t lexer_t;
 
-lexer_t    *lexer_new(FILE *input);
+lexer_t    *lexer_new(const char *src, size_t length);
 void        lexer_release(lexer_t **plexer);
 void        lexer_next(lexer_t *lexer);
 int         lexer_is_eof(lexer_t *lexer);
@@ -13,4 +14,6 @@ ttype_t     lexer_ttype(lexer_t *lexer);
 location_t  lexer_get_location(lexer_t *lexer);
 int         lexer_int_value(lexer_t *lexer);
 const char *lexer_text(lexer_t *lexer);
+int         lexer_text_length(lexer_t *lexer);
 int         lexer_get_error_count(lexer_t *lexer);
+location_t  lexer_get_error_location(lexer_t *lexer);
@@ -2,6 +2,9 @@
 
 #include <stdbool.h>
 #include "operator.h"
+#include "utils/arena.h"
+#include "utils/array.h"
+#include "utils/symbol.h"
 
 typedef enum {
   NT_INVALID,
@@ -38,48 +41,51 @@ typedef enum {
 
 typedef struct node_t node_t;
 
-node_t     *node_new(ntype_t ntype);
-node_t     *node_new_invalid(void);
-node_t     *node_new_group(node_t *child, const char *group_label);
-node_t     *node_new_empty(void);
-node_t     *node_new_seq(void);
-node_t     *node_new_expr(node_t *expr);
-node_t     *node_new_unary(unary_op_t uop, node_t *arg);
-node_t     *node_new_binary(binary_op_t bop, node_t *lhs, node_t *rhs);
-node_t     *node_new_assign(node_t *lhs, node_t *rhs);
-node_t     *node_new_integer(int value);
-node_t     *node_new_ident(const char *name);
-node_t     *node_new_variable(node_t *ident);
-node_t     *node_new_array(node_t *ident, node_t *indexer);
-node_t     *node_new_func_call(node_t *ident, node_t *arg);
-node_t     *node_new_func_call_arg(void);
-node_t     *node_new_if(node_t *cond, node_t *then, node_t *els);
-node_t     *node_new_while(node_t *cond, node_t *body);
-node_t     *node_new_loop_statement(node_t *body);
-node_t     *node_new_for_statement(node_t *init, node_t *cond, node_t *next, node_t *body);
-node_t     *node_new_break(void);
-node_t     *node_new_continue(void);
-node_t     *node_new_puti(node_t *expr);
-node_t     *node_new_putc(node_t *expr);
-node_t     *node_new_geti(node_t *var);
-node_t     *node_new_getc(node_t *var);
-node_t     *node_new_array_decl(node_t *ident, node_t *capacity);
-node_t     *node_new_return(node_t *expr);
-node_t     *node_new_halt(void);
-node_t     *node_new_func(node_t *ident, node_t *param, node_t *body);
-node_t     *node_new_func_param(void);
-node_t     *node_new_const_statement(node_t *ident, node_t *value);
+node_t     *node_new(arena_t *arena, ntype_t ntype);
+node_t     *node_new_invalid(arena_t *arena);
+node_t     *node_new_group(arena_t *arena, node_t *child, const char *group_label);
+node_t     *node_new_empty(arena_t *arena);
+node_t     *node_new_seq(arena_t *arena);
+node_t     *node_new_expr(arena_t *arena, node_t *expr);
+node_t     *node_new_unary(arena_t *arena, unary_op_t uop, node_t *arg);
+node_t     *node_new_binary(arena_t *arena, binary_op_t bop, node_t *lhs, node_t *rhs);
+node_t     *node_new_assign(arena_t *arena, node_t *lhs, node_t *rhs);
+node_t     *node_new_integer(arena_t *arena, int value);
+node_t     *node_new_ident(arena_t *arena, symbol_t name);
+node_t     *node_new_variable(arena_t *arena, node_t *ident);
+node_t     *node_new_array(arena_t *arena, node_t *ident, node_t *indexer);
+node_t     *node_new_func_call(arena_t *arena, node_t *ident, node_t *arg);
+node_t     *node_new_func_call_arg(arena_t *arena);
+node_t     *node_new_if(arena_t *arena, node_t *cond, node_t *then, node_t *els);
+node_t     *node_new_while(arena_t *arena, node_t *cond, node_t *body);
+node_t     *node_new_loop_statement(arena_t *arena, node_t *body);
+node_t     *node_new_for_statement(arena_t *arena, node_t *init, node_t *cond, node_t *next, node_t *body);
+node_t     *node_new_break(arena_t *arena);
+node_t     *node_new_continue(arena_t *arena);
+node_t     *node_new_puti(arena_t *arena, node_t *expr);
+node_t     *node_new_putc(arena_t *arena, node_t *expr);
+node_t     *node_new_geti(arena_t *arena, node_t *var);
+node_t     *node_new_getc(arena_t *arena, node_t *var);
+node_t     *node_new_array_decl(arena_t *arena, node_t *ident, node_t *capacity);
+node_t     *node_new_return(arena_t *arena, node_t *expr);
+node_t     *node_new_halt(arena_t *arena);
+node_t     *node_new_func(arena_t *arena, node_t *ident, node_t *param, node_t *body);
+node_t     *node_new_func_param(arena_t *arena);
+node_t     *node_new_const_statement(arena_t *arena, node_t *ident, node_t *value);
 
-void        node_release(node_t **pnode);
-
-void        node_add_child(node_t *node, node_t *child);
+void        node_add_child(arena_t *arena, node_t *node, node_t *child);
+void        node_set_child(node_t *node, int i, node_t *child);
+void        node_set_integer(node_t *node, int value);
 node_t     *node_get_child(node_t *node, int i);
 int         node_get_child_count(node_t *node);
 ntype_t     node_get_ntype(node_t *node);
 unary_op_t  node_get_uop(node_t *node);
 binary_op_t node_get_bop(node_t *node);
 int         node_get_value(node_t *node);
+symbol_t    node_get_symbol(node_t *node);
 const char *node_get_name(node_t *node);
 int         node_is_assignable(node_t *node);
 
 bool        node_is_all_paths_ended_with_return(node_t *node);
+bool        node_has_side_effects(node_t *node);
+void        node_collect_const_defs(node_t *node, array_t *defs);
@@ -1,11 +1,13 @@
 #pragma once
 
-#include <stdio.h>
+#include <stddef.h>
 #include "node.h"
+#include "utils/sink.h"
 
 typedef struct parser_t parser_t;
 
-parser_t *parser_new(FILE *input);
+parser_t *parser_new(const char *src, size_t length);
 void      parser_release(parser_t **pparser);
 node_t   *parser_parse(parser_t *parser);
 int       parser_get_total_error_count(parser_t *parser);
+void      parser_set_messages(parser_t *parser, sink_t *messages);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "inst.h"
+
+int peephole_optimize(insts_t *instructions);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "inst.h"
+
+int relabel_optimize(insts_t *instructions);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include "ttype.h"
+#include "location.h"
+#include "utils/sink.h"
+
+/*
+ * The whole source lexed up front into parallel arrays, one entry per
+ * token, always ending with a TT_EOF token. Tokens are read by index, so
+ * any amount of lookahead is possible. Token text refers to the source,
+ * which must outlive the stream.
+ *
+ * Unrecognizable characters become TT_UNKNOWN tokens whose value is the
+ * character. Their errors are printed by tokens_report_errors, so that they
+ * interleave with the parser's errors in source order. They go to the
+ * messages sink, or to standard error if it is NULL.
+ */
+typedef struct tokens_t tokens_t;
+
+tokens_t   *tokens_new(const char *src, size_t length);
+void        tokens_release(tokens_t **ptokens);
+int         tokens_count(tokens_t *tokens);
+ttype_t     tokens_ttype(tokens_t *tokens, int i);
+const char *tokens_text(tokens_t *tokens, int i);
+int         tokens_text_length(tokens_t *tokens, int i);
+int         tokens_int_value(tokens_t *tokens, int i);
+location_t  tokens_location(tokens_t *tokens, int i);
+int         tokens_get_error_count(tokens_t *tokens);
+void        tokens_report_errors(tokens_t *tokens, int i, sink_t *messages);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct arena_t arena_t;
+
+arena_t *arena_new(size_t chunk_size);
+void     arena_release(arena_t **parena);
+void    *arena_alloc(arena_t *arena, size_t size);
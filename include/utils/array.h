@@ -7,4 +7,6 @@ void     array_release(array_t **parray);
 void     array_append(array_t *array, void *item);
 int      array_count(array_t *array);
 void    *array_get(array_t *array, int index);
+void     array_set(array_t *array, int index, void *item);
+void     array_truncate(array_t *array, int count);
 array_t *array_concat(array_t *array1, array_t *array2);
@@ -0,0 +1,11 @@
+#pragma once
+
+typedef void (*pool_task_t)(void *context, int index);
+
+/*
+ * Run task(context, i) for every i in [0, count) on up to jobs threads.
+ * Indices are handed out in increasing order as threads become free, and
+ * the call returns once every task has finished. With one job the tasks
+ * run on the calling thread.
+ */
+void pool_run(int jobs, int count, pool_task_t task, void *context);
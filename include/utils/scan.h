@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+ * Byte scanning kernels for the lexer. The best implementation for the
+ * running CPU (AVX2, SSE2 or plain C) is picked by scanner_get.
+ *
+ * skip_space returns the first byte in [p, end) that is not whitespace. It
+ * adds the number of newlines it passed to *lines and, if there was one,
+ * points *line_start just past the last of them.
+ *
+ * find_newline returns the first '\n' in [p, end), or end.
+ */
+typedef struct {
+  const char  *name;
+  const char *(*skip_space)(const char *p, const char *end, int *lines, const char **line_start);
+  const char *(*find_newline)(const char *p, const char *end);
+} scanner_t;
+
+const scanner_t *scanner_get(void);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Destination of generated code: a stream, a growable memory buffer or a
+ * user callback.
+ */
+typedef struct sink_t sink_t;
+
+typedef void (*sink_callback_t)(void *context, const char *data, size_t length);
+
+sink_t     *sink_new_file(FILE *fp);
+sink_t     *sink_new_memory(void);
+sink_t     *sink_new_callback(sink_callback_t callback, void *context);
+void        sink_release(sink_t **psink);
+void        sink_write(sink_t *sink, const char *data, size_t length);
+void        sink_printf(sink_t *sink, const char *fmt, ...);
+void        sink_vprintf(sink_t *sink, const char *fmt, va_list args);
+void        sink_flush(sink_t *sink);
+const char *sink_get_data(sink_t *sink);
+size_t      sink_get_size(sink_t *sink);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * A whole source text in memory. Files are memory-mapped where possible,
+ * other streams are read to the end.
+ */
+typedef struct source_t source_t;
+
+source_t   *source_open(const char *path);
+source_t   *source_read(FILE *fp);
+void        source_release(source_t **psource);
+const char *source_get_data(source_t *source);
+size_t      source_get_size(source_t *source);
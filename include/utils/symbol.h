@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Interned strings. Equal names always map to the same symbol, so symbols
+ * can be compared with '==' and used as small integer keys. A compilation
+ * calls symbol_acquire before interning and symbol_release when it no
+ * longer needs its symbols; the table is freed when the last user releases.
+ */
+typedef int symbol_t;
+
+#define SYMBOL_NONE ( -1 )
+
+symbol_t    symbol_intern(const char *name);
+symbol_t    symbol_intern_n(const char *name, size_t length);
+const char *symbol_get_name(symbol_t symbol);
+void        symbol_acquire(void);
+void        symbol_release(void);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "utils/symbol.h"
+
+/*
+ * Open-addressing hash map from symbols to pointers. The map does not own
+ * its values.
+ */
+typedef struct symmap_t symmap_t;
+
+symmap_t *symmap_new(int initial_capacity);
+void      symmap_release(symmap_t **pmap);
+void     *symmap_get(symmap_t *map, symbol_t key);
+void      symmap_put(symmap_t *map, symbol_t key, void *value);
+int       symmap_count(symmap_t *map);
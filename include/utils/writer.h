@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+#include "utils/sink.h"
+
+/*
+ * Buffered output. Small writes are collected in memory and handed to the
+ * sink in large chunks.
+ */
+typedef struct writer_t writer_t;
+
+writer_t *writer_new(sink_t *sink);
+void      writer_release(writer_t **pwriter);
+void      writer_write(writer_t *writer, const char *data, size_t length);
+void      writer_putc(writer_t *writer, char c);
+void      writer_puts(writer_t *writer, const char *s);
+void      writer_printf(writer_t *writer, const char *fmt, ...);
+void      writer_flush(writer_t *writer);
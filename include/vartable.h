@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include "utils/symbol.h"
 
 typedef struct varentry_t varentry_t;
 typedef struct vartable_t vartable_t;
@@ -9,8 +10,8 @@ vartable_t *vartable_new(vartable_t *parent);
 void        vartable_release(vartable_t **pvartable);
 
 vartable_t *vartable_get_parent(vartable_t *vartable);
-varentry_t *vartable_add_var(vartable_t *vartable, const char *name, int size);
-varentry_t *vartable_lookup_or_add_var(vartable_t *vartable, const char *name);
+varentry_t *vartable_add_var(vartable_t *vartable, symbol_t name, int size);
+varentry_t *vartable_lookup_or_add_var(vartable_t *vartable, symbol_t name);
 
 int         varentry_get_offset(varentry_t *e);
 bool        varentry_is_local(varentry_t *e);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "inst.h"
+
+typedef struct vm_t vm_t;
+
+vm_t *vm_new(insts_t *instructions);
+void  vm_release(vm_t **pvm);
+void  vm_run(vm_t *vm);
+int   vm_get_error_count(vm_t *vm);
@@ -0,0 +1,82 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include "akarin.h"
+#include "parser.h"
+#include "fold.h"
+#include "codegen.h"
+#include "cfg.h"
+#include "peephole.h"
+#include "relabel.h"
+#include "emitter_ws.h"
+#include "utils/sink.h"
+#include "utils/symbol.h"
+
+int akarin_compile(const char *src, size_t len, int optimize, int jobs, sink_t *sink) {
+  parser_t *parser;
+  sink_t *messages;
+  node_t *node;
+  int error_count;
+
+  symbol_acquire();
+  parser = parser_new(src, len);
+  messages = sink_new_file(stderr);
+  parser_set_messages(parser, messages);
+  node = parser_parse(parser);
+  error_count = parser_get_total_error_count(parser);
+
+  if (error_count == 0) {
+    codegen_t *codegen = akarin_generate(node, optimize, jobs, false, messages);
+    error_count = codegen_get_error_count(codegen);
+
+    if (error_count == 0) {
+      emitter_t *emitter = emitter_ws_new(" ", "\t", "\n", true);
+      emitter_emit_code(emitter, codegen_get_instructions(codegen), sink);
+      emitter_release(&emitter);
+    }
+
+    codegen_release(&codegen);
+  }
+
+  parser_release(&parser);
+  sink_release(&messages);
+  symbol_release();
+
+  return error_count;
+}
+
+codegen_t *akarin_generate(node_t *node, int optimize, int jobs, bool verbose, sink_t *messages) {
+  codegen_t *codegen;
+
+  if (optimize > 0) {
+    int folded = fold_optimize(node);
+    if (verbose) {
+      sink_printf(messages, "fold: %d nodes folded.\n", folded);
+    }
+  }
+
+  codegen = codegen_new(node, jobs < 1 ? 1 : jobs, optimize);
+  codegen_set_messages(codegen, messages);
+  codegen_generate(codegen);
+
+  if (codegen_get_error_count(codegen) == 0 && optimize > 0) {
+    insts_t *insts = codegen_get_instructions(codegen);
+    int jumps, removed, saved;
+
+    jumps = cfg_optimize(insts);
+    if (verbose) {
+      sink_printf(messages, "cfg: %d jumps removed.\n", jumps);
+    }
+
+    removed = peephole_optimize(insts);
+    if (verbose) {
+      sink_printf(messages, "peephole: %d instructions removed.\n", removed);
+    }
+
+    saved = relabel_optimize(insts);
+    if (verbose) {
+      sink_printf(messages, "relabel: %d label symbols saved.\n", saved);
+    }
+  }
+
+  return codegen;
+}
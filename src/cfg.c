@@ -0,0 +1,630 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "cfg.h"
+#include "inst.h"
+#include "label.h"
+#include "utils/memory.h"
+
+#define NO_BLOCK      ( -1 )
+#define STACK_UNKNOWN ( INT_MIN )
+
+typedef enum {
+  EXIT_FALL,   /* into next */
+  EXIT_JMP,    /* to target */
+  EXIT_BRANCH, /* to target or into next */
+  EXIT_RET,
+  EXIT_HALT
+} exit_t;
+
+/*
+ * The body of a block is a range of the original code without the leading
+ * label and the closing jump, which are kept as label, exit and successors.
+ * Stack depths are counted in values; the depth on entry is relative to the
+ * entry of the enclosing function.
+ */
+typedef struct {
+  int      label;        /* LABEL_NONE if only reached by falling through */
+  int      first;
+  int      count;
+  int      size;         /* instructions in the body other than NOPs */
+  exit_t   exit;
+  opcode_t branch;       /* OP_JZ or OP_JNEG */
+  int      target;
+  int      next;         /* NO_BLOCK when falling off the end of the code */
+  int      stack_effect; /* change of the depth over the block, exit included */
+  int      stack_in;     /* depth on entry, relative to the entry of the function */
+  bool     reachable;
+  bool     referenced;   /* its label is emitted */
+  bool     placed;
+} block_t;
+
+struct cfg_t {
+  inst_t  *code;
+  int      code_count;
+  block_t *blocks;
+  int      block_count;
+  int      block_capacity;
+  int     *label_blocks;
+  int      label_count;
+  int     *order;
+  int      order_count;
+  bool     valid;
+};
+
+static void build(cfg_t *cfg);
+static int  add_block(cfg_t *cfg);
+static void mark_reachable(cfg_t *cfg);
+static void reach(cfg_t *cfg, int b, int *stack, int *top);
+static void keep_order(cfg_t *cfg);
+static void annotate_stack(cfg_t *cfg);
+static void enter_block(cfg_t *cfg, int b, int depth, int *stack, int *top);
+static void stack_change(const inst_t *inst, int *pops, int *pushes);
+static int  skip_empty(cfg_t *cfg, int b);
+static void place_chain(cfg_t *cfg, int b, const int *fall_ins);
+static bool falls_into(cfg_t *cfg, int k, int b);
+static int  block_label(cfg_t *cfg, int b);
+static bool is_exit(opcode_t opcode);
+static int  count_jumps(insts_t *instructions);
+
+cfg_t *cfg_new(insts_t *instructions) {
+  cfg_t *cfg = (cfg_t *)AK_MEM_MALLOC(sizeof(cfg_t));
+  int count = insts_count(instructions);
+
+  cfg->code = (inst_t *)AK_MEM_MALLOC(sizeof(inst_t) * (count + 1));
+  memcpy(cfg->code, insts_data(instructions), sizeof(inst_t) * count);
+  cfg->code_count = count;
+  cfg->blocks = NULL;
+  cfg->block_count = 0;
+  cfg->block_capacity = 0;
+  cfg->label_blocks = NULL;
+  cfg->label_count = 0;
+  cfg->order = NULL;
+  cfg->order_count = 0;
+  cfg->valid = true;
+
+  build(cfg);
+  cfg->order = (int *)AK_MEM_MALLOC(sizeof(int) * (cfg->block_count + 1));
+  if (cfg->valid) {
+    mark_reachable(cfg);
+    keep_order(cfg);
+    annotate_stack(cfg);
+  }
+  return cfg;
+}
+
+void cfg_release(cfg_t **pcfg) {
+  cfg_t *cfg = *pcfg;
+  AK_MEM_FREE(cfg->code);
+  AK_MEM_FREE(cfg->blocks);
+  AK_MEM_FREE(cfg->label_blocks);
+  AK_MEM_FREE(cfg->order);
+  AK_MEM_FREE(cfg);
+  *pcfg = NULL;
+}
+
+/*
+ * false if a jump goes to a label that is not defined or a block is entered
+ * with different stack depths; such code is left alone
+ */
+bool cfg_is_valid(cfg_t *cfg) {
+  return cfg->valid;
+}
+
+/*
+ * Jumps and branches to an empty block go straight to where that block
+ * leads, so chains of jumps collapse into one. A jump to an empty block
+ * that returns or halts becomes that RET or HALT.
+ */
+void cfg_thread_jumps(cfg_t *cfg) {
+  for (int b = 0; b < cfg->block_count; ++b) {
+    block_t *block = &cfg->blocks[b];
+
+    if (!block->reachable) {
+      continue;
+    }
+    if (block->exit == EXIT_JMP || block->exit == EXIT_BRANCH) {
+      block->target = skip_empty(cfg, block->target);
+    }
+    if (block->next != NO_BLOCK) {
+      block->next = skip_empty(cfg, block->next);
+    }
+    if (block->exit == EXIT_JMP) {
+      block_t *target = &cfg->blocks[block->target];
+      if (target->size == 0 && (target->exit == EXIT_RET || target->exit == EXIT_HALT)) {
+        block->exit = target->exit;
+      }
+    }
+  }
+
+  /* blocks only passed through may no longer be reached */
+  mark_reachable(cfg);
+  keep_order(cfg);
+}
+
+/*
+ * Chain blocks so each is followed by its successor: the block it falls
+ * into, or else the block it jumps to if nothing else falls into that one.
+ * Chains start in the original order, the entry first, and a block that
+ * something falls into only starts a chain when it is still left over.
+ */
+void cfg_layout(cfg_t *cfg) {
+  int *fall_ins = (int *)AK_MEM_CALLOC(cfg->block_count + 1, sizeof(int));
+
+  for (int b = 0; b < cfg->block_count; ++b) {
+    cfg->blocks[b].placed = false;
+    if (cfg->blocks[b].reachable && cfg->blocks[b].next != NO_BLOCK) {
+      fall_ins[cfg->blocks[b].next]++;
+    }
+  }
+
+  cfg->order_count = 0;
+  if (cfg->block_count > 0) {
+    place_chain(cfg, 0, fall_ins);
+  }
+  for (int b = 0; b < cfg->block_count; ++b) {
+    if (fall_ins[b] == 0) {
+      place_chain(cfg, b, fall_ins);
+    }
+  }
+  for (int b = 0; b < cfg->block_count; ++b) {
+    place_chain(cfg, b, fall_ins);
+  }
+
+  AK_MEM_FREE(fall_ins);
+}
+
+/*
+ * Write the reachable blocks in their order. A jump to the block that
+ * follows is left out, and a block whose successor does not follow it
+ * gets a JMP. Only labels something jumps to or calls are written.
+ */
+void cfg_lower(cfg_t *cfg, insts_t *instructions) {
+  for (int b = 0; b < cfg->block_count; ++b) {
+    cfg->blocks[b].referenced = false;
+  }
+
+  for (int k = 0; k < cfg->order_count; ++k) {
+    block_t *block = &cfg->blocks[cfg->order[k]];
+
+    if ((block->exit == EXIT_JMP && !falls_into(cfg, k, block->target)) ||
+        (block->exit == EXIT_BRANCH && block->target != block->next)) {
+      cfg->blocks[block->target].referenced = true;
+    }
+    if (block->next != NO_BLOCK && !falls_into(cfg, k, block->next)) {
+      cfg->blocks[block->next].referenced = true;
+    }
+    for (int i = block->first; i < block->first + block->count; ++i) {
+      inst_t *inst = &cfg->code[i];
+      if (inst->opcode == OP_CALL && inst->label < cfg->label_count && cfg->label_blocks[inst->label] != NO_BLOCK) {
+        cfg->blocks[cfg->label_blocks[inst->label]].referenced = true;
+      }
+    }
+  }
+
+  insts_truncate(instructions, 0);
+
+  for (int k = 0; k < cfg->order_count; ++k) {
+    int b = cfg->order[k];
+    block_t *block = &cfg->blocks[b];
+
+    if (block->referenced) {
+      insts_append(instructions, inst_label(block_label(cfg, b)));
+    }
+    for (int i = block->first; i < block->first + block->count; ++i) {
+      if (cfg->code[i].opcode != OP_NOP) {
+        insts_append(instructions, cfg->code[i]);
+      }
+    }
+
+    switch (block->exit) {
+    case EXIT_JMP:
+      if (!falls_into(cfg, k, block->target)) {
+        insts_append(instructions, inst_jmp(block_label(cfg, block->target)));
+      }
+      break;
+    case EXIT_BRANCH:
+      if (block->target == block->next) {
+        insts_append(instructions, inst_pop());
+      }
+      else if (block->branch == OP_JZ) {
+        insts_append(instructions, inst_jz(block_label(cfg, block->target)));
+      }
+      else {
+        insts_append(instructions, inst_jneg(block_label(cfg, block->target)));
+      }
+      break;
+    case EXIT_RET:
+      insts_append(instructions, inst_ret());
+      break;
+    case EXIT_HALT:
+      insts_append(instructions, inst_halt());
+      break;
+    default:
+      break;
+    }
+
+    if (block->exit == EXIT_FALL || block->exit == EXIT_BRANCH) {
+      if (block->next == NO_BLOCK) {
+        /* it fell off the end of the code, which halts */
+        if (k + 1 < cfg->order_count) {
+          insts_append(instructions, inst_halt());
+        }
+      }
+      else if (!falls_into(cfg, k, block->next)) {
+        insts_append(instructions, inst_jmp(block_label(cfg, block->next)));
+      }
+    }
+  }
+}
+
+/* returns the number of jumps and branches removed */
+int cfg_optimize(insts_t *instructions) {
+  cfg_t *cfg = cfg_new(instructions);
+  int before = count_jumps(instructions);
+
+  if (cfg_is_valid(cfg)) {
+    cfg_thread_jumps(cfg);
+    cfg_layout(cfg);
+    cfg_lower(cfg, instructions);
+  }
+  cfg_release(&cfg);
+
+  return before - count_jumps(instructions);
+}
+
+static void build(cfg_t *cfg) {
+  inst_t *code = cfg->code;
+  int count = cfg->code_count;
+  int i = 0;
+
+  for (int k = 0; k < count; ++k) {
+    if (inst_has_label(&code[k]) && code[k].label >= cfg->label_count) {
+      cfg->label_count = code[k].label + 1;
+    }
+  }
+  cfg->label_blocks = (int *)AK_MEM_MALLOC(sizeof(int) * (cfg->label_count + 1));
+  for (int k = 0; k < cfg->label_count; ++k) {
+    cfg->label_blocks[k] = NO_BLOCK;
+  }
+
+  for (;;) {
+    int b;
+    block_t *block;
+
+    while (i < count && code[i].opcode == OP_NOP) {
+      ++i;
+    }
+    if (i == count) {
+      break;
+    }
+
+    b = add_block(cfg);
+    block = &cfg->blocks[b];
+    if (code[i].opcode == OP_LABEL) {
+      block->label = code[i].label;
+      cfg->label_blocks[code[i].label] = b;
+      ++i;
+    }
+
+    block->first = i;
+    while (i < count && code[i].opcode != OP_LABEL && !is_exit(code[i].opcode)) {
+      if (code[i].opcode != OP_NOP) {
+        block->size++;
+      }
+      ++i;
+    }
+    block->count = i - block->first;
+
+    if (i < count && is_exit(code[i].opcode)) {
+      switch (code[i].opcode) {
+      case OP_JMP:
+        block->exit = EXIT_JMP;
+        block->target = code[i].label;
+        break;
+      case OP_JZ:
+      case OP_JNEG:
+        block->exit = EXIT_BRANCH;
+        block->branch = code[i].opcode;
+        block->target = code[i].label;
+        break;
+      case OP_RET:
+        block->exit = EXIT_RET;
+        break;
+      default:
+        block->exit = EXIT_HALT;
+        break;
+      }
+      ++i;
+    }
+    if (block->exit == EXIT_FALL || block->exit == EXIT_BRANCH) {
+      block->next = i < count ? b + 1 : NO_BLOCK;
+    }
+  }
+
+  /* targets were recorded as labels until every label had its block */
+  for (int b = 0; b < cfg->block_count; ++b) {
+    block_t *block = &cfg->blocks[b];
+
+    if (block->exit == EXIT_JMP || block->exit == EXIT_BRANCH) {
+      block->target = cfg->label_blocks[block->target];
+      if (block->target == NO_BLOCK) {
+        cfg->valid = false;
+      }
+    }
+  }
+
+  /* trailing NOPs can leave a fall-through past the last block */
+  if (cfg->block_count > 0 && cfg->blocks[cfg->block_count - 1].next == cfg->block_count) {
+    cfg->blocks[cfg->block_count - 1].next = NO_BLOCK;
+  }
+}
+
+static int add_block(cfg_t *cfg) {
+  block_t *block;
+
+  if (cfg->block_count == cfg->block_capacity) {
+    cfg->block_capacity = cfg->block_capacity > 0 ? cfg->block_capacity * 2 : 64;
+    cfg->blocks = (block_t *)AK_MEM_REALLOC(cfg->blocks, sizeof(block_t) * cfg->block_capacity);
+  }
+
+  block = &cfg->blocks[cfg->block_count];
+  block->label = LABEL_NONE;
+  block->first = 0;
+  block->count = 0;
+  block->size = 0;
+  block->exit = EXIT_FALL;
+  block->branch = OP_NOP;
+  block->target = NO_BLOCK;
+  block->next = NO_BLOCK;
+  block->stack_effect = 0;
+  block->stack_in = STACK_UNKNOWN;
+  block->reachable = false;
+  block->referenced = false;
+  block->placed = false;
+  return cfg->block_count++;
+}
+
+/* control enters at the first block and at every block called */
+static void mark_reachable(cfg_t *cfg) {
+  int *stack = (int *)AK_MEM_MALLOC(sizeof(int) * (cfg->block_count + 1));
+  int top = 0;
+
+  for (int b = 0; b < cfg->block_count; ++b) {
+    cfg->blocks[b].reachable = false;
+  }
+  reach(cfg, 0, stack, &top);
+
+  while (top > 0) {
+    block_t *block = &cfg->blocks[stack[--top]];
+
+    reach(cfg, block->target, stack, &top);
+    reach(cfg, block->next, stack, &top);
+    for (int i = block->first; i < block->first + block->count; ++i) {
+      inst_t *inst = &cfg->code[i];
+      if (inst->opcode == OP_CALL && inst->label < cfg->label_count) {
+        reach(cfg, cfg->label_blocks[inst->label], stack, &top);
+      }
+    }
+  }
+
+  AK_MEM_FREE(stack);
+}
+
+static void reach(cfg_t *cfg, int b, int *stack, int *top) {
+  if (b != NO_BLOCK && b < cfg->block_count && !cfg->blocks[b].reachable) {
+    cfg->blocks[b].reachable = true;
+    stack[(*top)++] = b;
+  }
+}
+
+/* the reachable blocks in their original order */
+static void keep_order(cfg_t *cfg) {
+  cfg->order_count = 0;
+  for (int b = 0; b < cfg->block_count; ++b) {
+    if (cfg->blocks[b].reachable) {
+      cfg->order[cfg->order_count++] = b;
+    }
+  }
+}
+
+/*
+ * Work out each block's stack effect, then the depth on entry to every
+ * block from the entries of the functions. Code generation keeps the depth
+ * the same on every path into a block. Where it is not, the code is not
+ * what the passes expect and is left alone; debug builds report the block.
+ */
+static void annotate_stack(cfg_t *cfg) {
+  int *stack = (int *)AK_MEM_MALLOC(sizeof(int) * (cfg->block_count + 1));
+  int top = 0;
+
+  for (int b = 0; b < cfg->block_count; ++b) {
+    block_t *block = &cfg->blocks[b];
+    int depth = 0;
+
+    for (int i = block->first; i < block->first + block->count; ++i) {
+      int pops, pushes;
+      stack_change(&cfg->code[i], &pops, &pushes);
+      depth += pushes - pops;
+    }
+    if (block->exit == EXIT_BRANCH || block->exit == EXIT_RET) {
+      depth--;
+    }
+    block->stack_effect = depth;
+    block->stack_in = STACK_UNKNOWN;
+  }
+
+  if (cfg->block_count > 0) {
+    enter_block(cfg, 0, 0, stack, &top);
+  }
+  for (int i = 0; i < cfg->code_count; ++i) {
+    inst_t *inst = &cfg->code[i];
+    if (inst->opcode == OP_CALL && inst->label < cfg->label_count && cfg->label_blocks[inst->label] != NO_BLOCK) {
+      enter_block(cfg, cfg->label_blocks[inst->label], 0, stack, &top);
+    }
+  }
+
+  while (top > 0) {
+    block_t *block = &cfg->blocks[stack[--top]];
+    int depth = block->stack_in + block->stack_effect;
+
+    if (block->exit == EXIT_JMP || block->exit == EXIT_BRANCH) {
+      enter_block(cfg, block->target, depth, stack, &top);
+    }
+    if (block->next != NO_BLOCK) {
+      enter_block(cfg, block->next, depth, stack, &top);
+    }
+  }
+
+  AK_MEM_FREE(stack);
+}
+
+static void enter_block(cfg_t *cfg, int b, int depth, int *stack, int *top) {
+  block_t *block = &cfg->blocks[b];
+
+  if (block->stack_in == STACK_UNKNOWN) {
+    block->stack_in = depth;
+    stack[(*top)++] = b;
+  }
+  else if (block->stack_in != depth) {
+#ifdef DEBUG
+    fprintf(stderr, "cfg: block %d is entered with stack depths %d and %d.\n", b, block->stack_in, depth);
+#endif
+    cfg->valid = false;
+  }
+}
+
+/* values an instruction takes off the stack and puts back; a call leaves its result */
+static void stack_change(const inst_t *inst, int *pops, int *pushes) {
+  *pops = 0;
+  *pushes = 0;
+
+  switch (inst->opcode) {
+  case OP_PUSH:
+  case OP_CALL:
+    *pushes = 1;
+    break;
+  case OP_DUP:
+    *pops = 1;
+    *pushes = 2;
+    break;
+  case OP_COPY:
+    *pops = inst->value + 1;
+    *pushes = inst->value + 2;
+    break;
+  case OP_SLIDE:
+    *pops = inst->value + 1;
+    *pushes = 1;
+    break;
+  case OP_SWAP:
+    *pops = 2;
+    *pushes = 2;
+    break;
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+    *pops = 2;
+    *pushes = 1;
+    break;
+  case OP_STORE:
+    *pops = 2;
+    break;
+  case OP_LOAD:
+    *pops = 1;
+    *pushes = 1;
+    break;
+  case OP_POP:
+  case OP_PUTC:
+  case OP_PUTI:
+  case OP_GETC:
+  case OP_GETI:
+  case OP_JZ:
+  case OP_JNEG:
+  case OP_RET:
+    *pops = 1;
+    break;
+  default:
+    break;
+  }
+}
+
+/* the first block from b on that does something other than pass control on */
+static int skip_empty(cfg_t *cfg, int b) {
+  /* a cycle of empty blocks is an endless loop; any block of it will do */
+  for (int steps = 0; steps < cfg->block_count; ++steps) {
+    block_t *block = &cfg->blocks[b];
+
+    if (block->size > 0) {
+      break;
+    }
+    if (block->exit == EXIT_JMP) {
+      b = block->target;
+    }
+    else if (block->exit == EXIT_FALL && block->next != NO_BLOCK) {
+      b = block->next;
+    }
+    else {
+      break;
+    }
+  }
+  return b;
+}
+
+static void place_chain(cfg_t *cfg, int b, const int *fall_ins) {
+  while (b != NO_BLOCK && cfg->blocks[b].reachable && !cfg->blocks[b].placed) {
+    block_t *block = &cfg->blocks[b];
+
+    block->placed = true;
+    cfg->order[cfg->order_count++] = b;
+
+    if (block->next != NO_BLOCK) {
+      b = block->next;
+    }
+    else if (block->exit == EXIT_JMP && fall_ins[block->target] == 0) {
+      b = block->target;
+    }
+    else {
+      b = NO_BLOCK;
+    }
+  }
+}
+
+/* whether the block placed after position k is b */
+static bool falls_into(cfg_t *cfg, int k, int b) {
+  return k + 1 < cfg->order_count && cfg->order[k + 1] == b;
+}
+
+/* blocks entered only by falling through get a fresh label when jumped to */
+static int block_label(cfg_t *cfg, int b) {
+  if (cfg->blocks[b].label == LABEL_NONE) {
+    cfg->blocks[b].label = cfg->label_count++;
+  }
+  return cfg->blocks[b].label;
+}
+
+static bool is_exit(opcode_t opcode) {
+  switch (opcode) {
+  case OP_JMP:
+  case OP_JZ:
+  case OP_JNEG:
+  case OP_RET:
+  case OP_HALT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static int count_jumps(insts_t *instructions) {
+  int n = 0;
+  for (int i = 0; i < insts_count(instructions); ++i) {
+    opcode_t opcode = insts_get(instructions, i)->opcode;
+    if (opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNEG) {
+      ++n;
+    }
+  }
+  return n;
+}
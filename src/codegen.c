@@ -11,32 +11,74 @@
 #include "inst.h"
 #include "utils/memory.h"
 #include "utils/array.h"
+#include "utils/symbol.h"
+#include "utils/symmap.h"
+#include "utils/sink.h"
+#include "utils/pool.h"
 
 typedef struct {
-  char *name;
-  int   value;
+  symbol_t name;
+  int      value;
 } const_def_t;
 
+#define INLINE_NODE_LIMIT ( 24 )
+
 typedef struct {
-  char    *name;
-  label_t *label;
+  symbol_t name;
+  int      label;
   bool     resolved;
+  node_t  *node;
+  bool     inlinable;
 } func_def_t;
 
+/*
+ * Toplevel functions are generated independently, possibly on several
+ * threads. collect_symbols registers every function and global variable
+ * beforehand, so a worker only reads the shared tables; it has its own
+ * instructions, labels and diagnostics, which are merged in source order.
+ */
+typedef struct {
+  node_t     *node;
+  func_def_t *func;
+  bool        redefined;
+  bool        live;
+  codegen_t  *worker;
+} unit_t;
+
 struct codegen_t {
+  codegen_t  *parent;
   node_t     *root;
   ltable_t   *ltable;
   vartable_t *vartable;
   array_t    *consts;
+  symmap_t   *const_index;
   array_t    *funcs;
-  label_t    *label_continue;
-  label_t    *label_break;
+  symmap_t   *func_index;
+  int         label_continue;
+  int         label_break;
   int         stack_depth;
-  array_t    *insts;
+  insts_t    *insts;
   int         error_count;
+  int         jobs;
+  int         optimize;
+  array_t    *units;
+  sink_t     *messages;
+  func_def_t *func;
+  node_t     *params;
+  int         inline_exit;
 };
 
-static void collect_const_defs(codegen_t *codegen, node_t *node);
+static void collect_const_defs(codegen_t *codegen);
+static void collect_symbols(codegen_t *codegen, node_t *node);
+static void collect_func(codegen_t *codegen, node_t *node);
+static void collect_references(codegen_t *codegen, node_t *node);
+static void collect_reference(codegen_t *codegen, node_t *ident, bool check_const);
+static bool is_inline_candidate(node_t *node, int *budget);
+static void gen_unit(void *context, int index);
+static void mark_live_units(codegen_t *codegen, int label_main);
+static void merge_units(codegen_t *codegen);
+static codegen_t *worker_new(codegen_t *codegen);
+static void worker_release(codegen_t **pworker);
 static void gen(codegen_t *codegen, node_t *node);
 static void gen_sequence(codegen_t *codegen, node_t *node);
 static void gen_expr_statement(codegen_t *codegen, node_t *node);
@@ -53,32 +95,50 @@ static void gen_geti_statement(codegen_t *codegen, node_t *node);
 static void gen_array_decl_statement(codegen_t *codegen, node_t *node);
 static void gen_func_statement(codegen_t *codegen, node_t *node);
 static void gen_return_statement(codegen_t *codegen, node_t *node);
+static void gen_tail_call(codegen_t *codegen, node_t *node);
+static bool is_self_tail_call(codegen_t *codegen, node_t *node);
+static void gen_cond(codegen_t *codegen, node_t *node, int target, bool jump_if);
 static void gen_unary(codegen_t *codegen, node_t *node);
 static void gen_binary(codegen_t *codegen, node_t *node);
 static void gen_assign(codegen_t *codegen, node_t *node);
 static void gen_variable(codegen_t *codegen, node_t *node);
 static void gen_array(codegen_t *codegen, node_t *node);
 static void gen_func_call(codegen_t *codegen, node_t *node);
-static void emit_inst(codegen_t *codegen, inst_t *inst);
-static label_t *alloc_label(codegen_t *codegen);
-static int  allocate(codegen_t *codegen, const char *name, int size);
-static void register_const(codegen_t *codegen, const char *name, int value);
-static const_def_t *lookup_const(codegen_t *codegen, const char *name);
-static func_def_t *lookup_or_register_func(codegen_t *codegen, const char *name);
+static void gen_inline_call(codegen_t *codegen, func_def_t *func, node_t *node);
+static void emit_inst(codegen_t *codegen, inst_t inst);
+static int  alloc_label(codegen_t *codegen);
+static int  allocate(codegen_t *codegen, symbol_t name, int size);
+static void register_const(codegen_t *codegen, symbol_t name, int value);
+static const_def_t *lookup_const(codegen_t *codegen, symbol_t name);
+static func_def_t *lookup_or_register_func(codegen_t *codegen, symbol_t name);
 static void error(codegen_t *codegen, const char *fmt, ...);
 
-codegen_t *codegen_new(node_t *root) {
+/*
+ * Functions are generated on up to jobs threads. With optimize > 0, a
+ * function returning a call to itself jumps back to its entry instead.
+ */
+codegen_t *codegen_new(node_t *root, int jobs, int optimize) {
   codegen_t *codegen = (codegen_t *)AK_MEM_MALLOC(sizeof(codegen_t));
+  codegen->parent = NULL;
   codegen->root = root;
   codegen->ltable = ltable_new();
   codegen->vartable = vartable_new(NULL);
   codegen->consts = array_new(64);
+  codegen->const_index = symmap_new(64);
   codegen->funcs = array_new(64);
-  codegen->label_continue = NULL;
-  codegen->label_break = NULL;
+  codegen->func_index = symmap_new(64);
+  codegen->label_continue = LABEL_NONE;
+  codegen->label_break = LABEL_NONE;
   codegen->stack_depth = 0;
-  codegen->insts = array_new(256);
+  codegen->insts = insts_new(256);
   codegen->error_count = 0;
+  codegen->jobs = jobs;
+  codegen->optimize = optimize;
+  codegen->units = array_new(64);
+  codegen->messages = NULL;
+  codegen->func = NULL;
+  codegen->params = NULL;
+  codegen->inline_exit = LABEL_NONE;
   return codegen;
 }
 
@@ -90,50 +150,121 @@ void codegen_release(codegen_t **pcodegen) {
 
   for (int i = 0; i < array_count(c->consts); ++i) {
     const_def_t *cdef = (const_def_t *)array_get(c->consts, i);
-    AK_MEM_FREE(cdef->name);
     AK_MEM_FREE(cdef);
   }
   array_release(&c->consts);
+  symmap_release(&c->const_index);
 
   for (int i = 0; i < array_count(c->funcs); ++i) {
     func_def_t *f = (func_def_t *)array_get(c->funcs, i);
-    AK_MEM_FREE(f->name);
     AK_MEM_FREE(f);
   }
   array_release(&c->funcs);
+  symmap_release(&c->func_index);
+
+  insts_release(&c->insts);
 
-  for (int i = 0; i < array_count(c->insts); ++i) {
-    inst_t *inst = (inst_t *)array_get(c->insts, i);
-    AK_MEM_FREE(inst);
+  for (int i = 0; i < array_count(c->units); ++i) {
+    unit_t *unit = (unit_t *)array_get(c->units, i);
+    if (unit->worker) {
+      worker_release(&unit->worker);
+    }
+    AK_MEM_FREE(unit);
   }
-  array_release(&c->insts);
+  array_release(&c->units);
 
   AK_MEM_FREE(c);
   *pcodegen = NULL;
 }
 
+static codegen_t *worker_new(codegen_t *codegen) {
+  codegen_t *worker = (codegen_t *)AK_MEM_MALLOC(sizeof(codegen_t));
+
+  /* the root, constants, functions and globals are shared */
+  *worker = *codegen;
+  worker->parent = codegen;
+  worker->ltable = ltable_new_after(codegen->ltable);
+  worker->label_continue = LABEL_NONE;
+  worker->label_break = LABEL_NONE;
+  worker->stack_depth = 0;
+  worker->insts = insts_new(256);
+  worker->error_count = 0;
+  worker->units = NULL;
+  worker->messages = NULL;
+  return worker;
+}
+
+static void worker_release(codegen_t **pworker) {
+  codegen_t *w = *pworker;
+
+  ltable_release(&w->ltable);
+
+  insts_release(&w->insts);
+
+  if (w->messages) {
+    sink_release(&w->messages);
+  }
+
+  AK_MEM_FREE(w);
+  *pworker = NULL;
+}
+
+/*
+ * Merge runs of adjacent labels, then renumber the labels still in use
+ * densely, in the order of their ids, so every reference uses the
+ * unified label's final number.
+ */
 static void unify_labels(codegen_t *codegen) {
-  array_t *insts = codegen->insts;
-
-  for (int i = 0; i < array_count(insts) - 1; ++i) {
-    inst_t *inst1 = (inst_t *)array_get(insts, i);
-    inst_t *inst2 = (inst_t *)array_get(insts, i + 1);
-    if (inst1->opcode == OP_LABEL && inst2->opcode == OP_LABEL) {
-      label_unify(inst1->label, inst2->label);
-      inst1->opcode = OP_NOP;
+  inst_t *insts = insts_data(codegen->insts);
+  int count = insts_count(codegen->insts);
+  int label_count = ltable_count(codegen->ltable);
+  int *numbers = (int *)AK_MEM_MALLOC(sizeof(int) * (label_count + 1));
+  int next = 0;
+
+  for (int i = 0; i < count - 1; ++i) {
+    if (insts[i].opcode == OP_LABEL && insts[i + 1].opcode == OP_LABEL) {
+      ltable_unify(codegen->ltable, insts[i].label, insts[i + 1].label);
+      insts[i].opcode = OP_NOP;
     }
   }
+
+  for (int i = 0; i < label_count; ++i) {
+    numbers[i] = -1;
+  }
+  for (int i = 0; i < count; ++i) {
+    if (inst_has_label(&insts[i])) {
+      insts[i].label = ltable_find(codegen->ltable, insts[i].label);
+      numbers[insts[i].label] = 0;
+    }
+  }
+  for (int i = 0; i < label_count; ++i) {
+    if (numbers[i] == 0) {
+      numbers[i] = next++;
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    if (inst_has_label(&insts[i])) {
+      insts[i].label = numbers[insts[i].label];
+    }
+  }
+
+  AK_MEM_FREE(numbers);
 }
 
 void codegen_generate(codegen_t *codegen) {
-  func_def_t *func_main = lookup_or_register_func(codegen, "main");
+  func_def_t *func_main = lookup_or_register_func(codegen, symbol_intern("main"));
 
-  collect_const_defs(codegen, codegen->root);
+  collect_const_defs(codegen);
+  collect_symbols(codegen, codegen->root);
 
-  emit_inst(codegen, inst_new_call(func_main->label));
-  emit_inst(codegen, inst_new_halt());
+  emit_inst(codegen, inst_call(func_main->label));
+  emit_inst(codegen, inst_halt());
 
-  gen(codegen, codegen->root);
+  pool_run(codegen->jobs, array_count(codegen->units), gen_unit, codegen);
+  if (codegen->optimize > 0) {
+    mark_live_units(codegen, func_main->label);
+  }
+  merge_units(codegen);
 
   if (!func_main->resolved) {
     error(codegen, "error: function 'main' is not defined.\n");
@@ -142,27 +273,226 @@ void codegen_generate(codegen_t *codegen) {
   unify_labels(codegen);
 }
 
+/* diagnostics go to the sink instead of standard error; it is not owned */
+void codegen_set_messages(codegen_t *codegen, sink_t *messages) {
+  codegen->messages = messages;
+}
+
 int codegen_get_error_count(codegen_t *codegen) {
   return codegen->error_count;
 }
 
-array_t *codegen_get_instructions(codegen_t *codegen) {
+insts_t *codegen_get_instructions(codegen_t *codegen) {
   return codegen->insts;
 }
 
-static void collect_const_defs(codegen_t *codegen, node_t *node) {
-  switch (node_get_ntype(node)) {
-  case NT_SEQ:
-    for (int i = 0; i < node_get_child_count(node); ++i) {
-      collect_const_defs(codegen, node_get_child(node, i));
+static void collect_const_defs(codegen_t *codegen) {
+  array_t *defs = array_new(16);
+
+  node_collect_const_defs(codegen->root, defs);
+  for (int i = 0; i < array_count(defs); ++i) {
+    node_t *def = (node_t *)array_get(defs, i);
+    register_const(codegen, node_get_symbol(node_get_child(def, 0)), node_get_value(node_get_child(def, 1)));
+  }
+
+  array_release(&defs);
+}
+
+/* register the globals and functions of the program in source order */
+static void collect_symbols(codegen_t *codegen, node_t *node) {
+  for (int i = 0; i < node_get_child_count(node); ++i) {
+    node_t *child = node_get_child(node, i);
+    switch (node_get_ntype(child)) {
+    case NT_ARRAY_DECL:
+      gen_array_decl_statement(codegen, child);
+      break;
+    case NT_FUNC:
+      collect_func(codegen, child);
+      break;
+    default:
+      break;
     }
+  }
+
+  if (codegen->optimize > 0) {
+    for (int i = 0; i < array_count(codegen->funcs); ++i) {
+      func_def_t *func = (func_def_t *)array_get(codegen->funcs, i);
+      int budget = INLINE_NODE_LIMIT;
+      func->inlinable = func->node && is_inline_candidate(node_get_child(func->node, 2), &budget);
+    }
+  }
+}
+
+/* small leaf functions, which cannot be recursive, are inlined at their call sites */
+static bool is_inline_candidate(node_t *node, int *budget) {
+  if (node_get_ntype(node) == NT_FUNC_CALL || --*budget < 0) {
+    return false;
+  }
+  for (int i = 0; i < node_get_child_count(node); ++i) {
+    if (!is_inline_candidate(node_get_child(node, i), budget)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void collect_func(codegen_t *codegen, node_t *node) {
+  node_t *param = node_get_child(node, 1);
+  func_def_t *func = lookup_or_register_func(codegen, node_get_symbol(node_get_child(node, 0)));
+  unit_t *unit = (unit_t *)AK_MEM_MALLOC(sizeof(unit_t));
+  vartable_t *vartable_local;
+
+  unit->node = node;
+  unit->func = func;
+  unit->redefined = func->resolved;
+  unit->live = true;
+  unit->worker = NULL;
+  array_append(codegen->units, unit);
+
+  if (unit->redefined) {
+    return;
+  }
+  func->resolved = true;
+  func->node = node;
+
+  vartable_local = vartable_new(codegen->vartable);
+  for (int i = 0; i < node_get_child_count(param); ++i) {
+    vartable_add_var(vartable_local, node_get_symbol(node_get_child(param, i)), 1);
+  }
+
+  codegen->vartable = vartable_local;
+  collect_references(codegen, node_get_child(node, 2));
+  codegen->vartable = vartable_get_parent(vartable_local);
+  vartable_release(&vartable_local);
+}
+
+/* every name gen looks up in the function or variable tables */
+static void collect_references(codegen_t *codegen, node_t *node) {
+  int first = 0;
+
+  switch (node_get_ntype(node)) {
+  case NT_FUNC_CALL:
+    lookup_or_register_func(codegen, node_get_symbol(node_get_child(node, 0)));
+    first = 1;
     break;
-  case NT_CONST_STATEMENT:
-    register_const(codegen, node_get_name(node_get_child(node, 0)), node_get_value(node_get_child(node, 1)));
+  case NT_VARIABLE:
+  case NT_ARRAY:
+    collect_reference(codegen, node_get_child(node, 0), true);
+    first = 1;
+    break;
+  case NT_GETC:
+  case NT_GETI:
+    collect_reference(codegen, node_get_child(node, 0), false);
+    first = 1;
     break;
   default:
     break;
   }
+
+  for (int i = first; i < node_get_child_count(node); ++i) {
+    collect_references(codegen, node_get_child(node, i));
+  }
+}
+
+static void collect_reference(codegen_t *codegen, node_t *ident, bool check_const) {
+  symbol_t name = node_get_symbol(ident);
+
+  if (!check_const || !lookup_const(codegen, name)) {
+    vartable_lookup_or_add_var(codegen->vartable, name);
+  }
+}
+
+static void gen_unit(void *context, int index) {
+  codegen_t *codegen = (codegen_t *)context;
+  unit_t *unit = (unit_t *)array_get(codegen->units, index);
+
+  if (!unit->redefined) {
+    unit->worker = worker_new(codegen);
+    gen(unit->worker, unit->node);
+  }
+}
+
+/*
+ * A function is live if main reaches it through calls. The calls are taken
+ * from the generated code, so calls that were inlined do not count. Every
+ * function is still generated, so errors in dead ones are reported.
+ */
+static void mark_live_units(codegen_t *codegen, int label_main) {
+  int unit_count = array_count(codegen->units);
+  int label_count = ltable_count(codegen->ltable);
+  int *units = (int *)AK_MEM_MALLOC(sizeof(int) * (label_count + 1));
+  int *stack = (int *)AK_MEM_MALLOC(sizeof(int) * (unit_count + 1));
+  int top = 0;
+
+  /* only function labels exist yet, and each has at most one unit */
+  for (int i = 0; i < label_count; ++i) {
+    units[i] = -1;
+  }
+  for (int i = 0; i < unit_count; ++i) {
+    unit_t *unit = (unit_t *)array_get(codegen->units, i);
+    unit->live = false;
+    if (!unit->redefined) {
+      units[unit->func->label] = i;
+    }
+  }
+
+  if (units[label_main] >= 0) {
+    ((unit_t *)array_get(codegen->units, units[label_main]))->live = true;
+    stack[top++] = units[label_main];
+  }
+  while (top > 0) {
+    insts_t *insts = ((unit_t *)array_get(codegen->units, stack[--top]))->worker->insts;
+
+    for (int k = 0; k < insts_count(insts); ++k) {
+      inst_t *inst = insts_get(insts, k);
+      if (inst->opcode == OP_CALL && inst->label < label_count && units[inst->label] >= 0) {
+        unit_t *callee = (unit_t *)array_get(codegen->units, units[inst->label]);
+        if (!callee->live) {
+          callee->live = true;
+          stack[top++] = units[inst->label];
+        }
+      }
+    }
+  }
+
+  AK_MEM_FREE(units);
+  AK_MEM_FREE(stack);
+}
+
+/* append the live functions' code and labels, and report their errors, in source order */
+static void merge_units(codegen_t *codegen) {
+  /* every worker numbered its own labels from here on */
+  int first = ltable_count(codegen->ltable);
+
+  for (int i = 0; i < array_count(codegen->units); ++i) {
+    unit_t *unit = (unit_t *)array_get(codegen->units, i);
+    codegen_t *worker = unit->worker;
+    int shift;
+
+    if (unit->redefined) {
+      error(codegen, "error: function '%s' is redefined.\n", symbol_get_name(node_get_symbol(node_get_child(unit->node, 0))));
+      continue;
+    }
+
+    shift = ltable_append(codegen->ltable, worker->ltable);
+    for (int k = 0; unit->live && k < insts_count(worker->insts); ++k) {
+      inst_t inst = *insts_get(worker->insts, k);
+      if (inst_has_label(&inst) && inst.label >= first) {
+        inst.label += shift;
+      }
+      insts_append(codegen->insts, inst);
+    }
+
+    if (worker->messages && codegen->messages) {
+      sink_write(codegen->messages, sink_get_data(worker->messages), sink_get_size(worker->messages));
+    }
+    else if (worker->messages) {
+      fwrite(sink_get_data(worker->messages), 1, sink_get_size(worker->messages), stderr);
+    }
+    codegen->error_count += worker->error_count;
+
+    worker_release(&unit->worker);
+  }
 }
 
 static void gen(codegen_t *codegen, node_t *node) {
@@ -241,7 +571,7 @@ static void gen(codegen_t *codegen, node_t *node) {
     gen_assign(codegen, node);
     break;
   case NT_INTEGER:
-    emit_inst(codegen, inst_new_push(node_get_value(node)));
+    emit_inst(codegen, inst_push(node_get_value(node)));
     codegen->stack_depth++;
     break;
   case NT_VARIABLE:
@@ -255,7 +585,7 @@ static void gen(codegen_t *codegen, node_t *node) {
     gen_func_call(codegen, node);
     break;
   case NT_HALT:
-    emit_inst(codegen, inst_new_halt());
+    emit_inst(codegen, inst_halt());
     break;
   default:
     break;
@@ -270,7 +600,7 @@ static void gen_sequence(codegen_t *codegen, node_t *node) {
 
 static void gen_expr_statement(codegen_t *codegen, node_t *node) {
   gen(codegen, node);
-  emit_inst(codegen, inst_new_pop());
+  emit_inst(codegen, inst_pop());
 }
 
 static void gen_if_statement(codegen_t *codegen, node_t *node) {
@@ -283,46 +613,50 @@ static void gen_if_statement(codegen_t *codegen, node_t *node) {
   }
 
   if (els) {
-    label_t *l1 = alloc_label(codegen);
-    label_t *l2 = alloc_label(codegen);
+    int l1 = alloc_label(codegen);
+    int l2 = alloc_label(codegen);
 
-    gen(codegen, cond);
-    emit_inst(codegen, inst_new_jz(l1));
+    gen_cond(codegen, cond, l1, false);
     gen(codegen, then);
-    emit_inst(codegen, inst_new_jmp(l2));
-    emit_inst(codegen, inst_new_label(l1));
+    emit_inst(codegen, inst_jmp(l2));
+    emit_inst(codegen, inst_label(l1));
     gen(codegen, els);
-    emit_inst(codegen, inst_new_label(l2));
+    emit_inst(codegen, inst_label(l2));
   }
   else {
-    label_t *l = alloc_label(codegen);
+    int l = alloc_label(codegen);
 
-    gen(codegen, cond);
-    emit_inst(codegen, inst_new_jz(l));
+    gen_cond(codegen, cond, l, false);
     gen(codegen, then);
-    emit_inst(codegen, inst_new_label(l));
+    emit_inst(codegen, inst_label(l));
   }
 }
 
+/*
+ * The condition is tested at the bottom of the loop, so an iteration costs
+ * a single conditional jump back to the body.
+ */
 static void gen_while_statement(codegen_t *codegen, node_t *node) {
   node_t *cond = node_get_child(node, 0);
   node_t *body = node_get_child(node, 1);
-  label_t *label_continue = alloc_label(codegen);
-  label_t *label_break = alloc_label(codegen);
-  label_t *label_continue_before;
-  label_t *label_break_before;
+  int label_body = alloc_label(codegen);
+  int label_continue = alloc_label(codegen);
+  int label_break = alloc_label(codegen);
+  int label_continue_before;
+  int label_break_before;
 
   label_continue_before = codegen->label_continue;
   label_break_before = codegen->label_break;
   codegen->label_continue = label_continue;
   codegen->label_break = label_break;
 
-  emit_inst(codegen, inst_new_label(label_continue));
-  gen(codegen, cond);
-  emit_inst(codegen, inst_new_jz(label_break));
+  emit_inst(codegen, inst_jmp(label_continue));
+  emit_inst(codegen, inst_label(label_body));
   gen(codegen, body);
-  emit_inst(codegen, inst_new_jmp(label_continue));
-  emit_inst(codegen, inst_new_label(label_break));
+  emit_inst(codegen, inst_label(label_continue));
+  codegen->stack_depth = 0;
+  gen_cond(codegen, cond, label_body, true);
+  emit_inst(codegen, inst_label(label_break));
 
   codegen->label_continue = label_continue_before;
   codegen->label_break = label_break_before;
@@ -330,20 +664,20 @@ static void gen_while_statement(codegen_t *codegen, node_t *node) {
 
 static void gen_loop_statement(codegen_t *codegen, node_t *node) {
   node_t *body = node_get_child(node, 0);
-  label_t *label_continue = alloc_label(codegen);
-  label_t *label_break = alloc_label(codegen);
-  label_t *label_continue_before;
-  label_t *label_break_before;
+  int label_continue = alloc_label(codegen);
+  int label_break = alloc_label(codegen);
+  int label_continue_before;
+  int label_break_before;
 
   label_continue_before = codegen->label_continue;
   label_break_before = codegen->label_break;
   codegen->label_continue = label_continue;
   codegen->label_break = label_break;
 
-  emit_inst(codegen, inst_new_label(label_continue));
+  emit_inst(codegen, inst_label(label_continue));
   gen(codegen, body);
-  emit_inst(codegen, inst_new_jmp(label_continue));
-  emit_inst(codegen, inst_new_label(label_break));
+  emit_inst(codegen, inst_jmp(label_continue));
+  emit_inst(codegen, inst_label(label_break));
 
   codegen->label_continue = label_continue_before;
   codegen->label_break = label_break_before;
@@ -354,11 +688,12 @@ static void gen_for_statement(codegen_t *codegen, node_t *node) {
   node_t *cond = node_get_child(node, 1);
   node_t *next = node_get_child(node, 2);
   node_t *body = node_get_child(node, 3);
-  label_t *label_head = alloc_label(codegen);
-  label_t *label_continue = alloc_label(codegen);
-  label_t *label_break = alloc_label(codegen);
-  label_t *label_continue_before;
-  label_t *label_break_before;
+  int label_body = alloc_label(codegen);
+  int label_test = alloc_label(codegen);
+  int label_continue = alloc_label(codegen);
+  int label_break = alloc_label(codegen);
+  int label_continue_before;
+  int label_break_before;
 
   label_continue_before = codegen->label_continue;
   label_break_before = codegen->label_break;
@@ -368,152 +703,325 @@ static void gen_for_statement(codegen_t *codegen, node_t *node) {
   if (node_get_ntype(init) != NT_EMPTY) {
     codegen->stack_depth = 0;
     gen(codegen, init);
-    emit_inst(codegen, inst_new_pop());
+    emit_inst(codegen, inst_pop());
   }
 
-  emit_inst(codegen, inst_new_label(label_head));
-
-  if (node_get_ntype(cond) != NT_EMPTY) {
-    codegen->stack_depth = 0;
-    gen(codegen, cond);
-    emit_inst(codegen, inst_new_jz(label_break));
-  }
+  emit_inst(codegen, inst_jmp(label_test));
+  emit_inst(codegen, inst_label(label_body));
 
   codegen->stack_depth = 0;
   gen(codegen, body);
 
-  emit_inst(codegen, inst_new_label(label_continue));
+  emit_inst(codegen, inst_label(label_continue));
 
   if (node_get_ntype(next) != NT_EMPTY) {
     codegen->stack_depth = 0;
     gen(codegen, next);
-    emit_inst(codegen, inst_new_pop());
+    emit_inst(codegen, inst_pop());
+  }
+
+  emit_inst(codegen, inst_label(label_test));
+
+  if (node_get_ntype(cond) != NT_EMPTY) {
+    codegen->stack_depth = 0;
+    gen_cond(codegen, cond, label_body, true);
+  }
+  else {
+    emit_inst(codegen, inst_jmp(label_body));
   }
 
-  emit_inst(codegen, inst_new_jmp(label_head));
-  emit_inst(codegen, inst_new_label(label_break));
+  emit_inst(codegen, inst_label(label_break));
 
   codegen->label_continue = label_continue_before;
   codegen->label_break = label_break_before;
 }
 
 static void gen_break_statement(codegen_t *codegen, node_t *node) {
-  label_t *label = codegen->label_break;
-  if (!label) {
+  int label = codegen->label_break;
+  if (label == LABEL_NONE) {
     error(codegen, "error: illegal break statement.\n");
     return;
   }
 
-  emit_inst(codegen, inst_new_jmp(label));
+  emit_inst(codegen, inst_jmp(label));
 }
 
 static void gen_continue_statement(codegen_t *codegen, node_t *node) {
-  label_t *label = codegen->label_continue;
-  if (!label) {
+  int label = codegen->label_continue;
+  if (label == LABEL_NONE) {
     error(codegen, "error: illegal continue statement.\n");
     return;
   }
 
-  emit_inst(codegen, inst_new_jmp(label));
+  emit_inst(codegen, inst_jmp(label));
 }
 
 static void gen_putc_statement(codegen_t *codegen, node_t *node) {
   gen(codegen, node_get_child(node, 0));
-  emit_inst(codegen, inst_new_putc());
+  emit_inst(codegen, inst_putc());
 }
 
 static void gen_puti_statement(codegen_t *codegen, node_t *node) {
   gen(codegen, node_get_child(node, 0));
-  emit_inst(codegen, inst_new_puti());
+  emit_inst(codegen, inst_puti());
 }
 
 static void gen_getc_statement(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
-  const char *name = node_get_name(ident);
+  symbol_t name = node_get_symbol(ident);
   varentry_t *varentry = vartable_lookup_or_add_var(codegen->vartable, name);
 
   if (varentry_is_local(varentry)) {
-    error(codegen, "error: function parameter '%s' is readonly.\n", name);
+    error(codegen, "error: function parameter '%s' is readonly.\n", symbol_get_name(name));
     return;
   }
 
-  emit_inst(codegen, inst_new_push(varentry_get_offset(varentry)));
-  emit_inst(codegen, inst_new_getc());
+  emit_inst(codegen, inst_push(varentry_get_offset(varentry)));
+  emit_inst(codegen, inst_getc());
 }
 
 static void gen_geti_statement(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
-  const char *name = node_get_name(ident);
+  symbol_t name = node_get_symbol(ident);
   varentry_t *varentry = vartable_lookup_or_add_var(codegen->vartable, name);
 
   if (varentry_is_local(varentry)) {
-    error(codegen, "error: function parameter '%s' is readonly.\n", name);
+    error(codegen, "error: function parameter '%s' is readonly.\n", symbol_get_name(name));
     return;
   }
 
-  emit_inst(codegen, inst_new_push(varentry_get_offset(varentry)));
-  emit_inst(codegen, inst_new_geti());
+  emit_inst(codegen, inst_push(varentry_get_offset(varentry)));
+  emit_inst(codegen, inst_geti());
 }
 
 static void gen_array_decl_statement(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
   node_t *capacity = node_get_child(node, 1);
-  allocate(codegen, node_get_name(ident), node_get_value(capacity));
+  allocate(codegen, node_get_symbol(ident), node_get_value(capacity));
 }
 
 static void gen_func_statement(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
   node_t *param = node_get_child(node, 1);
   node_t *body = node_get_child(node, 2);
-  func_def_t *func = lookup_or_register_func(codegen, node_get_name(ident));
+  func_def_t *func = lookup_or_register_func(codegen, node_get_symbol(ident));
   vartable_t *vartable_local;
 
-  if (func->resolved) {
-    error(codegen, "error: function '%s' is redefined.\n", func->name);
-    return;
-  }
-  func->resolved = true;
-
   vartable_local = vartable_new(codegen->vartable);
 
   for (int i = 0; i < node_get_child_count(param); ++i) {
     node_t *param_ident = node_get_child(param, i);
-    vartable_add_var(vartable_local, node_get_name(param_ident), 1);
+    vartable_add_var(vartable_local, node_get_symbol(param_ident), 1);
   }
 
   codegen->vartable = vartable_local;
+  codegen->func = func;
+  codegen->params = param;
 
-  emit_inst(codegen, inst_new_label(func->label));
+  emit_inst(codegen, inst_label(func->label));
   gen(codegen, body);
 
+  codegen->func = NULL;
   codegen->vartable = vartable_get_parent(vartable_local);
   vartable_release(&vartable_local);
 }
 
 static void gen_return_statement(codegen_t *codegen, node_t *node) {
   node_t *expr = node_get_child(node, 0);
+
+  /* leave an inlined body with the value on top of its arguments */
+  if (codegen->inline_exit != LABEL_NONE) {
+    gen(codegen, expr);
+    emit_inst(codegen, inst_jmp(codegen->inline_exit));
+    return;
+  }
+
+  if (is_self_tail_call(codegen, expr)) {
+    gen_tail_call(codegen, expr);
+    return;
+  }
+
   gen(codegen, expr);
-  emit_inst(codegen, inst_new_ret());
+  emit_inst(codegen, inst_ret());
+}
+
+/*
+ * return f(args) inside f: the new first argument replaces the first
+ * parameter, which is on top of the stack, and control jumps back to the
+ * entry, so the recursion runs in constant stack space.
+ */
+static void gen_tail_call(codegen_t *codegen, node_t *node) {
+  node_t *args = node_get_child(node, 1);
+
+  if (node_get_child_count(args) > 0) {
+    gen(codegen, node_get_child(args, 0));
+    emit_inst(codegen, inst_slide(1));
+    codegen->stack_depth--;
+  }
+
+  emit_inst(codegen, inst_jmp(codegen->func->label));
+}
+
+/*
+ * Only the top of the stack can be replaced without going through the
+ * heap, which costs more than the CALL and RET saved. So every argument
+ * but the first must pass the parameter at its own position unchanged.
+ */
+static bool is_self_tail_call(codegen_t *codegen, node_t *node) {
+  node_t *args;
+
+  if (codegen->optimize == 0 || !codegen->func || node_get_ntype(node) != NT_FUNC_CALL ||
+      node_get_symbol(node_get_child(node, 0)) != codegen->func->name) {
+    return false;
+  }
+
+  args = node_get_child(node, 1);
+  if (node_get_child_count(args) != node_get_child_count(codegen->params)) {
+    return false;
+  }
+  for (int i = 1; i < node_get_child_count(args); ++i) {
+    node_t *arg = node_get_child(args, i);
+    symbol_t name = node_get_symbol(node_get_child(codegen->params, i));
+    if (node_get_ntype(arg) != NT_VARIABLE || node_get_symbol(node_get_child(arg, 0)) != name || lookup_const(codegen, name)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Generate a condition which jumps to the target if it evaluates to jump_if
+ * and falls through otherwise, without materializing a 0/1 value.
+ * Operands of '&' and '|' are evaluated eagerly in value context, so the
+ * right-hand side is only skipped here when it has no side effects.
+ */
+static void gen_cond(codegen_t *codegen, node_t *node, int target, bool jump_if) {
+  bool swap = false;
+  bool negate = false;
+  opcode_t test = OP_NOP;
+  int skip;
+
+  switch (node_get_ntype(node)) {
+  case NT_GROUP:
+    gen_cond(codegen, node_get_child(node, 0), target, jump_if);
+    return;
+  case NT_INTEGER:
+    if ((node_get_value(node) != 0) == jump_if) {
+      emit_inst(codegen, inst_jmp(target));
+    }
+    return;
+  case NT_UNARY:
+    if (node_get_uop(node) == UOP_NOT) {
+      gen_cond(codegen, node_get_child(node, 0), target, !jump_if);
+      return;
+    }
+    break;
+  case NT_BINARY:
+    switch (node_get_bop(node)) {
+    case BOP_AND:
+    case BOP_OR:
+      if (node_has_side_effects(node_get_child(node, 1))) {
+        break;
+      }
+      if (jump_if == (node_get_bop(node) == BOP_OR)) {
+        /* x | y jumps if either side is true, !(x & y) if either is false */
+        gen_cond(codegen, node_get_child(node, 0), target, jump_if);
+        gen_cond(codegen, node_get_child(node, 1), target, jump_if);
+      }
+      else {
+        skip = alloc_label(codegen);
+        gen_cond(codegen, node_get_child(node, 0), skip, !jump_if);
+        gen_cond(codegen, node_get_child(node, 1), target, jump_if);
+        emit_inst(codegen, inst_label(skip));
+      }
+      return;
+    case BOP_LT:  /* x < y  <=> x - y < 0 */
+      test = OP_JNEG;
+      break;
+    case BOP_GT:  /* x > y  <=> y - x < 0 */
+      test = OP_JNEG;
+      swap = true;
+      break;
+    case BOP_LE:  /* x <= y <=> !(y - x < 0) */
+      test = OP_JNEG;
+      swap = true;
+      negate = true;
+      break;
+    case BOP_GE:  /* x >= y <=> !(x - y < 0) */
+      test = OP_JNEG;
+      negate = true;
+      break;
+    case BOP_EQ:  /* x == y <=> x - y == 0 */
+      test = OP_JZ;
+      break;
+    case BOP_NEQ: /* x != y <=> !(x - y == 0) */
+      test = OP_JZ;
+      negate = true;
+      break;
+    default:
+      break;
+    }
+
+    if (test == OP_NOP) {
+      break;
+    }
+
+    gen(codegen, node_get_child(node, 0));
+    gen(codegen, node_get_child(node, 1));
+    if (swap) {
+      emit_inst(codegen, inst_swap());
+    }
+    emit_inst(codegen, inst_sub());
+    codegen->stack_depth -= 2;
+
+    if (jump_if != negate) {
+      emit_inst(codegen, test == OP_JZ ? inst_jz(target) : inst_jneg(target));
+    }
+    else {
+      skip = alloc_label(codegen);
+      emit_inst(codegen, test == OP_JZ ? inst_jz(skip) : inst_jneg(skip));
+      emit_inst(codegen, inst_jmp(target));
+      emit_inst(codegen, inst_label(skip));
+    }
+    return;
+  default:
+    break;
+  }
+
+  /* anything else is compared against zero */
+  gen(codegen, node);
+  codegen->stack_depth--;
+  if (!jump_if) {
+    emit_inst(codegen, inst_jz(target));
+  }
+  else {
+    skip = alloc_label(codegen);
+    emit_inst(codegen, inst_jz(skip));
+    emit_inst(codegen, inst_jmp(target));
+    emit_inst(codegen, inst_label(skip));
+  }
 }
 
 static void gen_unary(codegen_t *codegen, node_t *node) {
   switch (node_get_uop(node)) {
   case UOP_NEGATIVE: /* implement -x as 0 - x. */
-    emit_inst(codegen, inst_new_push(0));
+    emit_inst(codegen, inst_push(0));
+    codegen->stack_depth++;
     gen(codegen, node_get_child(node, 0));
-    emit_inst(codegen, inst_new_sub());
+    emit_inst(codegen, inst_sub());
+    codegen->stack_depth--;
     break;
   case UOP_NOT:
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
       gen(codegen, node_get_child(node, 0));
-      emit_inst(codegen, inst_new_jz(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_label(l2));
+      emit_inst(codegen, inst_jz(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   default:
@@ -527,135 +1035,135 @@ static void gen_binary(codegen_t *codegen, node_t *node) {
 
   switch (node_get_bop(node)) {
   case BOP_ADD:
-    emit_inst(codegen, inst_new_add());
+    emit_inst(codegen, inst_add());
     break;
   case BOP_SUB:
-    emit_inst(codegen, inst_new_sub());
+    emit_inst(codegen, inst_sub());
     break;
   case BOP_MUL:
-    emit_inst(codegen, inst_new_mul());
+    emit_inst(codegen, inst_mul());
     break;
   case BOP_DIV:
-    emit_inst(codegen, inst_new_div());
+    emit_inst(codegen, inst_div());
     break;
   case BOP_MOD:
-    emit_inst(codegen, inst_new_mod());
+    emit_inst(codegen, inst_mod());
     break;
   case BOP_OR:
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      label_t *l3 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_jz(l1));
-      emit_inst(codegen, inst_new_pop());
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_jmp(l3));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_jz(l2));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_jmp(l3));
-      emit_inst(codegen, inst_new_label(l2));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_label(l3));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      int l3 = alloc_label(codegen);
+      emit_inst(codegen, inst_jz(l1));
+      emit_inst(codegen, inst_pop());
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_jmp(l3));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_jz(l2));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_jmp(l3));
+      emit_inst(codegen, inst_label(l2));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_label(l3));
     }
     break;
   case BOP_AND:
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      label_t *l3 = alloc_label(codegen);
-      label_t *l4 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_jz(l1));
-      emit_inst(codegen, inst_new_jz(l2));
-      emit_inst(codegen, inst_new_jmp(l3));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_pop());
-      emit_inst(codegen, inst_new_label(l2));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_jmp(l4));
-      emit_inst(codegen, inst_new_label(l3));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_label(l4));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      int l3 = alloc_label(codegen);
+      int l4 = alloc_label(codegen);
+      emit_inst(codegen, inst_jz(l1));
+      emit_inst(codegen, inst_jz(l2));
+      emit_inst(codegen, inst_jmp(l3));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_pop());
+      emit_inst(codegen, inst_label(l2));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_jmp(l4));
+      emit_inst(codegen, inst_label(l3));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_label(l4));
     }
     break;
   case BOP_EQ:
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_sub());
-      emit_inst(codegen, inst_new_jz(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_label(l2));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      emit_inst(codegen, inst_sub());
+      emit_inst(codegen, inst_jz(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   case BOP_NEQ:
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_sub());
-      emit_inst(codegen, inst_new_jz(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_label(l2));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      emit_inst(codegen, inst_sub());
+      emit_inst(codegen, inst_jz(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   case BOP_LT: /* x < y --> x - y < 0 */
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_sub());
-      emit_inst(codegen, inst_new_jneg(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_label(l2));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      emit_inst(codegen, inst_sub());
+      emit_inst(codegen, inst_jneg(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   case BOP_LE: /* x <= y --> !(y - x < 0) */
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_swap());
-      emit_inst(codegen, inst_new_sub());
-      emit_inst(codegen, inst_new_jneg(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_label(l2));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      emit_inst(codegen, inst_swap());
+      emit_inst(codegen, inst_sub());
+      emit_inst(codegen, inst_jneg(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   case BOP_GT: /* x > y --> y - x < 0 */
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_swap());
-      emit_inst(codegen, inst_new_sub());
-      emit_inst(codegen, inst_new_jneg(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_label(l2));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      emit_inst(codegen, inst_swap());
+      emit_inst(codegen, inst_sub());
+      emit_inst(codegen, inst_jneg(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   case BOP_GE: /* x >= y --> !(x - y < 0) */
     {
-      label_t *l1 = alloc_label(codegen);
-      label_t *l2 = alloc_label(codegen);
-      emit_inst(codegen, inst_new_sub());
-      emit_inst(codegen, inst_new_jneg(l1));
-      emit_inst(codegen, inst_new_push(1));
-      emit_inst(codegen, inst_new_jmp(l2));
-      emit_inst(codegen, inst_new_label(l1));
-      emit_inst(codegen, inst_new_push(0));
-      emit_inst(codegen, inst_new_label(l2));
+      int l1 = alloc_label(codegen);
+      int l2 = alloc_label(codegen);
+      emit_inst(codegen, inst_sub());
+      emit_inst(codegen, inst_jneg(l1));
+      emit_inst(codegen, inst_push(1));
+      emit_inst(codegen, inst_jmp(l2));
+      emit_inst(codegen, inst_label(l1));
+      emit_inst(codegen, inst_push(0));
+      emit_inst(codegen, inst_label(l2));
     }
     break;
   default:
@@ -667,74 +1175,74 @@ static void gen_assign(codegen_t *codegen, node_t *node) {
   node_t *lhs = node_get_child(node, 0);
   node_t *expr = node_get_child(node, 1);
   node_t *ident = node_get_child(lhs, 0);
-  const char *name = node_get_name(ident);
+  symbol_t name = node_get_symbol(ident);
   varentry_t *varentry;
 
   if (lookup_const(codegen, name)) {
-    error(codegen, "error: cannot assign to '%s' defined as a constant.\n", name);
+    error(codegen, "error: cannot assign to '%s' defined as a constant.\n", symbol_get_name(name));
     return;
   }
 
   varentry = vartable_lookup_or_add_var(codegen->vartable, name);
   if (varentry_is_local(varentry)) {
-    error(codegen, "error: function parameter '%s' is readonly.\n", name);
+    error(codegen, "error: function parameter '%s' is readonly.\n", symbol_get_name(name));
     return;
   }
 
   gen(codegen, expr);
 
-  emit_inst(codegen, inst_new_push(varentry_get_offset(varentry)));
+  emit_inst(codegen, inst_push(varentry_get_offset(varentry)));
 
   if (node_get_ntype(lhs) == NT_ARRAY) {
     codegen->stack_depth++;
     gen(codegen, node_get_child(lhs, 1));
-    emit_inst(codegen, inst_new_add());
+    emit_inst(codegen, inst_add());
     codegen->stack_depth--;
   }
 
-  emit_inst(codegen, inst_new_copy(1));
-  emit_inst(codegen, inst_new_store());
-  codegen->stack_depth++;
+  /* the value stays on the stack, already counted by gen */
+  emit_inst(codegen, inst_copy(1));
+  emit_inst(codegen, inst_store());
 }
 
 static void gen_variable(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
-  const_def_t *cdef = lookup_const(codegen, node_get_name(ident));
+  const_def_t *cdef = lookup_const(codegen, node_get_symbol(ident));
   varentry_t *varentry;
   int offset;
 
   if (cdef) {
-    emit_inst(codegen, inst_new_push(cdef->value));
+    emit_inst(codegen, inst_push(cdef->value));
     return;
   }
 
-  varentry = vartable_lookup_or_add_var(codegen->vartable, node_get_name(ident));
+  varentry = vartable_lookup_or_add_var(codegen->vartable, node_get_symbol(ident));
   offset = varentry_get_offset(varentry);
 
   if (varentry_is_local(varentry)) {
-    emit_inst(codegen, inst_new_copy(codegen->stack_depth + offset));
+    emit_inst(codegen, inst_copy(codegen->stack_depth + offset));
   }
   else {
-    emit_inst(codegen, inst_new_push(offset));
-    emit_inst(codegen, inst_new_load());
+    emit_inst(codegen, inst_push(offset));
+    emit_inst(codegen, inst_load());
   }
 }
 
 static void gen_array(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
-  const char *name = node_get_name(ident);
+  symbol_t name = node_get_symbol(ident);
   varentry_t *varentry = vartable_lookup_or_add_var(codegen->vartable, name);
 
   if (varentry_is_local(varentry)) {
-    error(codegen, "error: function parameter '%s' is not array.\n", name);
+    error(codegen, "error: function parameter '%s' is not array.\n", symbol_get_name(name));
     return;
   }
 
-  emit_inst(codegen, inst_new_push(varentry_get_offset(varentry)));
+  emit_inst(codegen, inst_push(varentry_get_offset(varentry)));
   codegen->stack_depth++;
   gen(codegen, node_get_child(node, 1));
-  emit_inst(codegen, inst_new_add());
-  emit_inst(codegen, inst_new_load());
+  emit_inst(codegen, inst_add());
+  emit_inst(codegen, inst_load());
   codegen->stack_depth--;
 }
 
@@ -742,76 +1250,139 @@ static void gen_func_call(codegen_t *codegen, node_t *node) {
   node_t *ident = node_get_child(node, 0);
   node_t *args = node_get_child(node, 1);
   int arg_count = node_get_child_count(args);
-  func_def_t *func = lookup_or_register_func(codegen, node_get_name(ident));
+  func_def_t *func = lookup_or_register_func(codegen, node_get_symbol(ident));
+
+  if (func->inlinable && arg_count == node_get_child_count(node_get_child(func->node, 1))) {
+    gen_inline_call(codegen, func, node);
+    return;
+  }
 
   for (int i = arg_count - 1; i >= 0; --i) {
     gen(codegen, node_get_child(args, i));
   }
-  emit_inst(codegen, inst_new_call(func->label));
+  emit_inst(codegen, inst_call(func->label));
   codegen->stack_depth++;
-  emit_inst(codegen, inst_new_slide(arg_count));
+  emit_inst(codegen, inst_slide(arg_count));
   codegen->stack_depth -= arg_count;
 }
 
-static void emit_inst(codegen_t *codegen, inst_t *inst) {
-  array_append(codegen->insts, inst);
+/*
+ * The arguments are pushed as for a call and the callee's body is generated
+ * with stack_depth counted from them, so its parameters are read with the
+ * same COPY offsets as in a real frame. A return jumps to the exit, where
+ * SLIDE drops the arguments below the value, as after CALL.
+ */
+static void gen_inline_call(codegen_t *codegen, func_def_t *func, node_t *node) {
+  node_t *args = node_get_child(node, 1);
+  node_t *param = node_get_child(func->node, 1);
+  int arg_count = node_get_child_count(args);
+  int stack_depth = codegen->stack_depth;
+  vartable_t *vartable = codegen->vartable;
+  vartable_t *globals = vartable;
+  vartable_t *vartable_local;
+  int label_continue = codegen->label_continue;
+  int label_break = codegen->label_break;
+  int label_exit = alloc_label(codegen);
+
+  for (int i = arg_count - 1; i >= 0; --i) {
+    gen(codegen, node_get_child(args, i));
+  }
+
+  while (vartable_get_parent(globals)) {
+    globals = vartable_get_parent(globals);
+  }
+  vartable_local = vartable_new(globals);
+  for (int i = 0; i < node_get_child_count(param); ++i) {
+    vartable_add_var(vartable_local, node_get_symbol(node_get_child(param, i)), 1);
+  }
+
+  codegen->vartable = vartable_local;
+  codegen->label_continue = LABEL_NONE;
+  codegen->label_break = LABEL_NONE;
+  codegen->inline_exit = label_exit;
+
+  gen(codegen, node_get_child(func->node, 2));
+  emit_inst(codegen, inst_label(label_exit));
+  emit_inst(codegen, inst_slide(arg_count));
+
+  codegen->inline_exit = LABEL_NONE;
+  codegen->label_continue = label_continue;
+  codegen->label_break = label_break;
+  codegen->vartable = vartable;
+  codegen->stack_depth = stack_depth + 1;
+  vartable_release(&vartable_local);
+}
+
+static void emit_inst(codegen_t *codegen, inst_t inst) {
+  insts_append(codegen->insts, inst);
 }
 
-static label_t *alloc_label(codegen_t *codegen) {
+static int alloc_label(codegen_t *codegen) {
   return ltable_alloc(codegen->ltable);
 }
 
-static int allocate(codegen_t *codegen, const char *name, int size) {
+static int allocate(codegen_t *codegen, symbol_t name, int size) {
   varentry_t *e = vartable_add_var(codegen->vartable, name, size);
   return varentry_get_offset(e);
 }
 
-static void register_const(codegen_t *codegen, const char *name, int value) {
+static void register_const(codegen_t *codegen, symbol_t name, int value) {
   const_def_t *cdef = lookup_const(codegen, name);
 
   if (cdef) {
-    error(codegen, "error: constant '%s' is redefined.\n", name);
+    error(codegen, "error: constant '%s' is redefined.\n", symbol_get_name(name));
     return;
   }
 
   cdef = (const_def_t *)AK_MEM_MALLOC(sizeof(const_def_t));
-  cdef->name = AK_MEM_STRDUP(name);
+  cdef->name = name;
   cdef->value = value;
   array_append(codegen->consts, cdef);
+  symmap_put(codegen->const_index, name, cdef);
 }
 
-static const_def_t *lookup_const(codegen_t *codegen, const char *name) {
-  for (int i = 0; i < array_count(codegen->consts); ++i) {
-    const_def_t *cdef = (const_def_t *)array_get(codegen->consts, i);
-    if (strcmp(cdef->name, name) == 0) {
-      return cdef;
-    }
-  }
-  return NULL;
+static const_def_t *lookup_const(codegen_t *codegen, symbol_t name) {
+  return (const_def_t *)symmap_get(codegen->const_index, name);
 }
 
-static func_def_t *lookup_or_register_func(codegen_t *codegen, const char *name) {
-  func_def_t *func;
+static func_def_t *lookup_or_register_func(codegen_t *codegen, symbol_t name) {
+  func_def_t *func = (func_def_t *)symmap_get(codegen->func_index, name);
 
-  for (int i = 0; i < array_count(codegen->funcs); ++i) {
-    func = (func_def_t *)array_get(codegen->funcs, i);
-    if (strcmp(func->name, name) == 0) {
-      return func;
-    }
+  if (func) {
+    return func;
   }
 
   func = (func_def_t *)AK_MEM_MALLOC(sizeof(func_def_t));
-  func->name = AK_MEM_STRDUP(name);
+  func->name = name;
   func->label = alloc_label(codegen);
   func->resolved = false;
+  func->node = NULL;
+  func->inlinable = false;
   array_append(codegen->funcs, func);
+  symmap_put(codegen->func_index, name, func);
   return func;
 }
 
 static void error(codegen_t *codegen, const char *fmt, ...) {
   va_list args;
+
+  /* errors in an inlined body are reported where the function itself is generated */
+  if (codegen->inline_exit != LABEL_NONE) {
+    return;
+  }
+
+  /* a worker keeps its messages until the functions are merged */
+  if (codegen->parent && !codegen->messages) {
+    codegen->messages = sink_new_memory();
+  }
+
   va_start(args, fmt);
-  vfprintf(stderr, fmt, args);
+  if (codegen->messages) {
+    sink_vprintf(codegen->messages, fmt, args);
+  }
+  else {
+    vfprintf(stderr, fmt, args);
+  }
   va_end(args);
   codegen->error_count++;
 }
@@ -1,17 +1,18 @@
 #include "emitter.h"
 #include "inst.h"
 #include "utils/memory.h"
-#include "utils/array.h"
 
 void emitter_release(emitter_t **pemitter) {
   AK_MEM_FREE(*pemitter);
   *pemitter = NULL;
 }
 
-void emitter_emit_code(emitter_t *emitter, array_t *instructions) {
-  for (int i = 0; i < array_count(instructions); ++i) {
-    inst_t *inst = (inst_t *)array_get(instructions, i);
-    emitter->emit(emitter, inst);
+void emitter_emit_code(emitter_t *emitter, insts_t *instructions, sink_t *sink) {
+  emitter->writer = writer_new(sink);
+  emitter->begin(emitter);
+  for (int i = 0; i < insts_count(instructions); ++i) {
+    emitter->emit(emitter, insts_get(instructions, i));
   }
   emitter->end(emitter);
+  writer_release(&emitter->writer);
 }
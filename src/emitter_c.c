@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "opcode.h"
+#include "emitter.h"
+#include "utils/memory.h"
+
+typedef struct {
+  emitter_t base;
+  int       return_count;
+} emitter_c_t;
+
+static void c_begin(emitter_t *self);
+static void c_emit(emitter_t *self, inst_t *inst);
+static void c_end(emitter_t *self);
+
+/*
+ * Runtime part of the generated program. Whitespace labels become goto
+ * targets and return addresses are pushed as label values (a GNU C extension
+ * supported by GCC and Clang) so RET is a single computed goto. Instructions
+ * are emitted one at a time, so labels are marked unused rather than dropped
+ * when nothing jumps to them.
+ */
+static const char *g_prologue =
+  "#include <inttypes.h>\n"
+  "#include <stdint.h>\n"
+  "#include <stdio.h>\n"
+  "#include <stdlib.h>\n"
+  "\n"
+  "#define STACK_MAX ( 1 << 20 )\n"
+  "#define HEAP_MAX  ( 1 << 26 )\n"
+  "#define CALL_MAX  ( 1 << 18 )\n"
+  "\n"
+  "#define PUSH(X) do { int64_t v_ = (X); if (sp == st + STACK_MAX) fail(\"error: stack overflow.\\n\"); *sp++ = v_; } while (0)\n"
+  "#define CALL(L, R) do { if (rp == rs + CALL_MAX) fail(\"error: call stack overflow.\\n\"); *rp++ = &&R; goto L; } while (0)\n"
+  "#define RET() do { if (rp == rs) fail(\"error: return with empty call stack.\\n\"); goto **--rp; } while (0)\n"
+  "\n"
+  "static int64_t st[STACK_MAX];\n"
+  "static int64_t hp[HEAP_MAX];\n"
+  "static void   *rs[CALL_MAX];\n"
+  "\n"
+  "static void fail(const char *message) {\n"
+  "  fflush(stdout);\n"
+  "  fputs(message, stderr);\n"
+  "  exit(1);\n"
+  "}\n"
+  "\n"
+  "static inline int64_t *cell(int64_t address) {\n"
+  "  if (address < 0 || address >= HEAP_MAX) {\n"
+  "    fail(\"error: invalid heap address.\\n\");\n"
+  "  }\n"
+  "  return &hp[address];\n"
+  "}\n"
+  "\n"
+  "static inline int64_t divide(int64_t x, int64_t y) {\n"
+  "  int64_t q;\n"
+  "  if (y == 0) {\n"
+  "    fail(\"error: division by zero.\\n\");\n"
+  "  }\n"
+  "  q = x / y;\n"
+  "  return (x % y != 0 && (x < 0) != (y < 0)) ? q - 1 : q;\n"
+  "}\n"
+  "\n"
+  "static inline int64_t modulo(int64_t x, int64_t y) {\n"
+  "  int64_t r;\n"
+  "  if (y == 0) {\n"
+  "    fail(\"error: division by zero.\\n\");\n"
+  "  }\n"
+  "  r = x % y;\n"
+  "  return (r != 0 && (r < 0) != (y < 0)) ? r + y : r;\n"
+  "}\n"
+  "\n"
+  "static inline void geti(int64_t *p) {\n"
+  "  fflush(stdout);\n"
+  "  if (scanf(\"%\" SCNd64, p) != 1) {\n"
+  "    fail(\"error: failed to read an integer.\\n\");\n"
+  "  }\n"
+  "}\n"
+  "\n"
+  "static inline void getc_(int64_t *p) {\n"
+  "  fflush(stdout);\n"
+  "  *p = getchar();\n"
+  "}\n"
+  "\n"
+  "int main(void) {\n"
+  "  int64_t *sp = st;\n"
+  "  void   **rp = rs;\n"
+  "\n";
+
+static const char *g_epilogue =
+  "halt: __attribute__((unused));\n"
+  "  fflush(stdout);\n"
+  "  return 0;\n"
+  "}\n";
+
+emitter_t *emitter_c_new(void) {
+  emitter_c_t *emitter = (emitter_c_t *)AK_MEM_MALLOC(sizeof(emitter_c_t));
+  emitter->base.begin = c_begin;
+  emitter->base.emit = c_emit;
+  emitter->base.end = c_end;
+  emitter->base.writer = NULL;
+  emitter->return_count = 0;
+  return (emitter_t *)emitter;
+}
+
+static void c_begin(emitter_t *self) {
+  writer_puts(self->writer, g_prologue);
+}
+
+static void c_emit(emitter_t *self, inst_t *inst) {
+  emitter_c_t *emitter = (emitter_c_t *)self;
+
+  switch (inst->opcode) {
+  case OP_NOP:
+    break;
+  case OP_PUSH:
+    writer_printf(self->writer, "  PUSH(%d);\n", inst->value);
+    break;
+  case OP_COPY:
+    writer_printf(self->writer, "  PUSH(sp[%d]);\n", -1 - inst->value);
+    break;
+  case OP_SLIDE:
+    writer_printf(self->writer, "  sp[%d] = sp[-1]; sp -= %d;\n", -1 - inst->value, inst->value);
+    break;
+  case OP_DUP:
+    writer_puts(self->writer, "  PUSH(sp[-1]);\n");
+    break;
+  case OP_POP:
+    writer_puts(self->writer, "  --sp;\n");
+    break;
+  case OP_SWAP:
+    writer_puts(self->writer, "  { int64_t t = sp[-1]; sp[-1] = sp[-2]; sp[-2] = t; }\n");
+    break;
+  case OP_ADD:
+    writer_puts(self->writer, "  --sp; sp[-1] += sp[0];\n");
+    break;
+  case OP_SUB:
+    writer_puts(self->writer, "  --sp; sp[-1] -= sp[0];\n");
+    break;
+  case OP_MUL:
+    writer_puts(self->writer, "  --sp; sp[-1] *= sp[0];\n");
+    break;
+  case OP_DIV:
+    writer_puts(self->writer, "  --sp; sp[-1] = divide(sp[-1], sp[0]);\n");
+    break;
+  case OP_MOD:
+    writer_puts(self->writer, "  --sp; sp[-1] = modulo(sp[-1], sp[0]);\n");
+    break;
+  case OP_STORE:
+    writer_puts(self->writer, "  sp -= 2; *cell(sp[0]) = sp[1];\n");
+    break;
+  case OP_LOAD:
+    writer_puts(self->writer, "  sp[-1] = *cell(sp[-1]);\n");
+    break;
+  case OP_PUTC:
+    writer_puts(self->writer, "  putchar((int)*--sp);\n");
+    break;
+  case OP_PUTI:
+    writer_puts(self->writer, "  printf(\"%\" PRId64, *--sp);\n");
+    break;
+  case OP_GETC:
+    writer_puts(self->writer, "  getc_(cell(*--sp));\n");
+    break;
+  case OP_GETI:
+    writer_puts(self->writer, "  geti(cell(*--sp));\n");
+    break;
+  case OP_LABEL:
+    writer_printf(self->writer, "L%d: __attribute__((unused));\n", inst->label);
+    break;
+  case OP_CALL:
+    writer_printf(self->writer, "  CALL(L%d, R%d); R%d:;\n", inst->label, emitter->return_count, emitter->return_count);
+    emitter->return_count++;
+    break;
+  case OP_JMP:
+    writer_printf(self->writer, "  goto L%d;\n", inst->label);
+    break;
+  case OP_JZ:
+    writer_printf(self->writer, "  if (*--sp == 0) goto L%d;\n", inst->label);
+    break;
+  case OP_JNEG:
+    writer_printf(self->writer, "  if (*--sp < 0) goto L%d;\n", inst->label);
+    break;
+  case OP_RET:
+    writer_puts(self->writer, "  RET();\n");
+    break;
+  case OP_HALT:
+    writer_puts(self->writer, "  goto halt;\n");
+    break;
+  }
+}
+
+static void c_end(emitter_t *self) {
+  writer_puts(self->writer, g_epilogue);
+}
@@ -3,7 +3,6 @@
 #include <stdarg.h>
 #include "opcode.h"
 #include "emitter.h"
-#include "label.h"
 #include "utils/memory.h"
 
 typedef struct {
@@ -11,6 +10,7 @@ typedef struct {
   int       indent;
 } emitter_pseudo_t;
 
+static void pseudo_begin(emitter_t *self);
 static void pseudo_emit(emitter_t *self, inst_t *inst);
 static void pseudo_end(emitter_t *self);
 
@@ -19,12 +19,17 @@ static void indent(emitter_t *self);
 
 emitter_t *emitter_pseudo_new(int indent) {
   emitter_pseudo_t *emitter = (emitter_pseudo_t *)AK_MEM_MALLOC(sizeof(emitter_pseudo_t));
+  emitter->base.begin = pseudo_begin;
   emitter->base.emit = pseudo_emit;
   emitter->base.end = pseudo_end;
+  emitter->base.writer = NULL;
   emitter->indent = indent;
   return (emitter_t *)emitter;
 }
 
+static void pseudo_begin(emitter_t *self) {
+}
+
 static void pseudo_emit(emitter_t *self, inst_t *inst) {
   if (inst->opcode != OP_LABEL) {
     indent_printf(self, "%s", opcode_to_str(inst->opcode));
@@ -34,40 +39,43 @@ static void pseudo_emit(emitter_t *self, inst_t *inst) {
   case OP_PUSH:
   case OP_COPY:
   case OP_SLIDE:
-    printf(" %d", inst->value);
+    writer_printf(self->writer, " %d", inst->value);
     break;
   case OP_LABEL:
-    printf("L%d:", label_get_unified_id(inst->label));
+    writer_printf(self->writer, "L%d:", inst->label);
     break;
   case OP_CALL:
   case OP_JMP:
   case OP_JZ:
   case OP_JNEG:
-    printf(" L%d", label_get_unified_id(inst->label));
+    writer_printf(self->writer, " L%d", inst->label);
     break;
   default:
     break;
   }
 
-  putchar('\n');
+  writer_putc(self->writer, '\n');
 }
 
 static void pseudo_end(emitter_t *self) {
 }
 
 static void indent_printf(emitter_t *self, const char *fmt, ...) {
+  char buffer[256];
   va_list args;
 
   indent(self);
 
   va_start(args, fmt);
-  vprintf(fmt, args);
+  vsnprintf(buffer, sizeof(buffer), fmt, args);
   va_end(args);
+
+  writer_puts(self->writer, buffer);
 }
 
 static void indent(emitter_t *self) {
   int n = ((emitter_pseudo_t *)self)->indent;
   while (n-- > 0) {
-    putchar(' ');
+    writer_putc(self->writer, ' ');
   }
 }
@@ -1,56 +1,81 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "opcode.h"
 #include "emitter.h"
-#include "label.h"
 #include "utils/memory.h"
+#include "utils/writer.h"
 
+#define SYMBOL_MAX ( 8 )
+#define PREFIX_MAX ( 4 * SYMBOL_MAX )
+#define OPCODE_MAX ( OP_HALT + 1 )
+
+typedef struct {
+  char   text[PREFIX_MAX];
+  size_t length;
+} chunk_t;
+
+/*
+ * The space, tab and newline symbols and every opcode prefix are expanded
+ * once when the emitter is created, so emitting an instruction is a few
+ * buffer appends.
+ */
 typedef struct {
-  emitter_t   base;
-  const char *space;
-  const char *tab;
-  const char *newline;
-  bool        strict;
+  emitter_t  base;
+  chunk_t    space;
+  chunk_t    tab;
+  chunk_t    newline;
+  chunk_t    prefixes[OPCODE_MAX];
+  bool       strict;
 } emitter_ws_t;
 
+static void ws_begin(emitter_t *self);
 static void ws_emit(emitter_t *self, inst_t *inst);
 static void ws_end(emitter_t *self);
 
-static void encode_integer(emitter_t *self, int n);
-static void encode_uint(emitter_t *self, unsigned int n);
-static void encode_uint_rec(emitter_t *self, unsigned int n);
-static void emit_chars(emitter_t *self, const char *s);
-static void emit_char(emitter_t *self, char c);
+static void expand(emitter_ws_t *emitter, chunk_t *chunk, const char *s);
+static void set_symbol(chunk_t *chunk, const char *symbol);
+static void encode_integer(emitter_ws_t *emitter, int n);
+static void encode_uint(emitter_ws_t *emitter, unsigned int n);
+static void emit_chunk(emitter_ws_t *emitter, const chunk_t *chunk);
 
 emitter_t *emitter_ws_new(const char *space, const char *tab, const char *newline, bool strict) {
   emitter_ws_t *emitter = (emitter_ws_t *)AK_MEM_MALLOC(sizeof(emitter_ws_t));
+  emitter->base.begin = ws_begin;
   emitter->base.emit = ws_emit;
   emitter->base.end = ws_end;
-  emitter->space = space;
-  emitter->tab = tab;
-  emitter->newline = newline;
+  emitter->base.writer = NULL;
+  set_symbol(&emitter->space, space);
+  set_symbol(&emitter->tab, tab);
+  set_symbol(&emitter->newline, newline);
+  for (int i = 0; i < OPCODE_MAX; ++i) {
+    expand(emitter, &emitter->prefixes[i], opcode_to_ws((opcode_t)i));
+  }
   emitter->strict = strict;
   return (emitter_t *)emitter;
 }
 
+static void ws_begin(emitter_t *self) {
+}
+
 static void ws_emit(emitter_t *self, inst_t *inst) {
-  if (inst->opcode != OP_NOP) {
-    emit_chars(self, opcode_to_ws(inst->opcode));
-  }
+  emitter_ws_t *emitter = (emitter_ws_t *)self;
+
+  emit_chunk(emitter, &emitter->prefixes[inst->opcode]);
 
   switch (inst->opcode) {
   case OP_PUSH:
   case OP_COPY:
   case OP_SLIDE:
-    encode_integer(self, inst->value);
+    encode_integer(emitter, inst->value);
     break;
   case OP_LABEL:
   case OP_CALL:
   case OP_JMP:
   case OP_JZ:
   case OP_JNEG:
-    encode_uint(self, (unsigned int)label_get_unified_id(inst->label));
+    encode_uint(emitter, (unsigned int)inst->label);
     break;
   default:
     break;
@@ -62,53 +87,52 @@ static void ws_end(emitter_t *self) {
 
   /* if set to non-pure whitespace format, print newline on the end */
   if (!emitter->strict) {
-    putchar('\n');
+    writer_putc(self->writer, '\n');
   }
 }
 
-static void encode_integer(emitter_t *self, int n) {
-  emit_char(self, n >= 0 ? 'S' : 'T');
-  encode_uint(self, (unsigned int)abs(n));
+static void set_symbol(chunk_t *chunk, const char *symbol) {
+  chunk->length = strlen(symbol) < SYMBOL_MAX ? strlen(symbol) : SYMBOL_MAX;
+  memcpy(chunk->text, symbol, chunk->length);
 }
 
-static void encode_uint(emitter_t *self, unsigned int n) {
-  if (n == 0) {
-    emit_char(self, 'S');
-  }
-  else {
-    encode_uint_rec(self, n);
+/* expand an "STL" string with the emitter's symbols */
+static void expand(emitter_ws_t *emitter, chunk_t *chunk, const char *s) {
+  chunk->length = 0;
+  for (const char *p = s; *p; ++p) {
+    const chunk_t *symbol = *p == 'S' ? &emitter->space : *p == 'T' ? &emitter->tab : &emitter->newline;
+    memcpy(chunk->text + chunk->length, symbol->text, symbol->length);
+    chunk->length += symbol->length;
   }
-  emit_char(self, 'L');
 }
 
-static void encode_uint_rec(emitter_t *self, unsigned int n) {
-  if (n != 0) {
-    encode_uint_rec(self, n >> 1);
-    emit_char(self, (n & 1) ? 'T' : 'S');
-  }
+static void encode_integer(emitter_ws_t *emitter, int n) {
+  emit_chunk(emitter, n >= 0 ? &emitter->space : &emitter->tab);
+  /* negate in unsigned arithmetic so INT_MIN is encoded correctly */
+  encode_uint(emitter, n >= 0 ? (unsigned int)n : 0u - (unsigned int)n);
 }
 
-static void emit_chars(emitter_t *self, const char *s) {
-  const char *p = s;
-  while (*p) {
-    emit_char(self, *p++);
+/* binary digits from the most significant set bit down, then a newline */
+static void encode_uint(emitter_ws_t *emitter, unsigned int n) {
+  int bit;
+
+  if (n == 0) {
+    emit_chunk(emitter, &emitter->space);
   }
+  else {
+#if defined(__GNUC__)
+    bit = 31 - __builtin_clz(n);
+#else
+    for (bit = 31; !(n >> bit); --bit) {
+    }
+#endif
+    for (; bit >= 0; --bit) {
+      emit_chunk(emitter, ((n >> bit) & 1) ? &emitter->tab : &emitter->space);
+    }
+  }
+  emit_chunk(emitter, &emitter->newline);
 }
 
-static void emit_char(emitter_t *self, char c) {
-  emitter_ws_t *emitter = (emitter_ws_t *)self;
-  switch (c) {
-  case 'S':
-    printf("%s", emitter->space);
-    break;
-  case 'T':
-    printf("%s", emitter->tab);
-    break;
-  case 'L':
-    printf("%s", emitter->newline);
-    break;
-  default:
-    putchar(c);
-    break;
-  }
+static void emit_chunk(emitter_ws_t *emitter, const chunk_t *chunk) {
+  writer_write(emitter->base.writer, chunk->text, chunk->length);
 }
@@ -0,0 +1,237 @@
+#include <stdbool.h>
+#include <limits.h>
+#include "fold.h"
+#include "node.h"
+#include "operator.h"
+#include "utils/array.h"
+#include "utils/symbol.h"
+#include "utils/symmap.h"
+
+/*
+ * Folding works bottom-up. Each fold function returns the node that takes
+ * the place of the given one, either the node itself turned into an integer
+ * or one of its children. Dropped nodes stay in the parser's arena.
+ */
+typedef struct {
+  symmap_t *consts;
+  int       count;
+} fold_t;
+
+static node_t *fold_node(fold_t *fold, node_t *node);
+static node_t *fold_variable(fold_t *fold, node_t *node);
+static node_t *fold_unary(fold_t *fold, node_t *node);
+static node_t *fold_binary(fold_t *fold, node_t *node);
+static node_t *fold_identity(fold_t *fold, node_t *node);
+static node_t *replace_with_integer(fold_t *fold, node_t *node, long long value);
+static node_t *replace_with_child(fold_t *fold, node_t *node, int i);
+static bool    is_integer(node_t *node, int value);
+
+int fold_optimize(node_t *root) {
+  fold_t fold;
+  array_t *defs;
+
+  fold.consts = symmap_new(64);
+  fold.count = 0;
+
+  defs = array_new(16);
+  node_collect_const_defs(root, defs);
+  for (int i = 0; i < array_count(defs); ++i) {
+    node_t *def = (node_t *)array_get(defs, i);
+    /* a redefinition is reported by codegen, the first one is used */
+    if (!symmap_get(fold.consts, node_get_symbol(node_get_child(def, 0)))) {
+      symmap_put(fold.consts, node_get_symbol(node_get_child(def, 0)), def);
+    }
+  }
+
+  fold_node(&fold, root);
+
+  array_release(&defs);
+  symmap_release(&fold.consts);
+
+  return fold.count;
+}
+
+static node_t *fold_node(fold_t *fold, node_t *node) {
+  int first = 0;
+
+  switch (node_get_ntype(node)) {
+  case NT_ASSIGN:
+  case NT_GETI:
+  case NT_GETC:
+    /* keep the target variable, assigning to a constant is an error */
+    if (node_get_ntype(node_get_child(node, 0)) == NT_VARIABLE) {
+      first = 1;
+    }
+    break;
+  default:
+    break;
+  }
+
+  for (int i = first; i < node_get_child_count(node); ++i) {
+    node_t *child = node_get_child(node, i);
+    node_t *folded = fold_node(fold, child);
+    if (folded != child) {
+      node_set_child(node, i, folded);
+    }
+  }
+
+  switch (node_get_ntype(node)) {
+  case NT_VARIABLE:
+    return fold_variable(fold, node);
+  case NT_UNARY:
+    return fold_unary(fold, node);
+  case NT_BINARY:
+    return fold_binary(fold, node);
+  default:
+    return node;
+  }
+}
+
+static node_t *fold_variable(fold_t *fold, node_t *node) {
+  node_t *cdef = (node_t *)symmap_get(fold->consts, node_get_symbol(node_get_child(node, 0)));
+
+  if (cdef) {
+    return replace_with_integer(fold, node, node_get_value(node_get_child(cdef, 1)));
+  }
+  return node;
+}
+
+static node_t *fold_unary(fold_t *fold, node_t *node) {
+  node_t *x = node_get_child(node, 0);
+
+  if (node_get_ntype(x) != NT_INTEGER) {
+    return node;
+  }
+
+  switch (node_get_uop(node)) {
+  case UOP_NEGATIVE:
+    return replace_with_integer(fold, node, -(long long)node_get_value(x));
+  case UOP_NOT:
+    return replace_with_integer(fold, node, node_get_value(x) == 0);
+  default:
+    return node;
+  }
+}
+
+static node_t *fold_binary(fold_t *fold, node_t *node) {
+  node_t *lhs = node_get_child(node, 0);
+  node_t *rhs = node_get_child(node, 1);
+  long long x, y, q, r;
+
+  if (node_get_ntype(lhs) != NT_INTEGER || node_get_ntype(rhs) != NT_INTEGER) {
+    return fold_identity(fold, node);
+  }
+
+  x = node_get_value(lhs);
+  y = node_get_value(rhs);
+
+  switch (node_get_bop(node)) {
+  case BOP_ADD: return replace_with_integer(fold, node, x + y);
+  case BOP_SUB: return replace_with_integer(fold, node, x - y);
+  case BOP_MUL: return replace_with_integer(fold, node, x * y);
+  case BOP_DIV:
+  case BOP_MOD:
+    /* leave division by zero to the runtime */
+    if (y == 0) {
+      return node;
+    }
+    /* division rounds toward negative infinity */
+    q = x / y;
+    r = x % y;
+    if (r != 0 && (r < 0) != (y < 0)) {
+      --q;
+      r += y;
+    }
+    return replace_with_integer(fold, node, node_get_bop(node) == BOP_DIV ? q : r);
+  case BOP_EQ:  return replace_with_integer(fold, node, x == y);
+  case BOP_NEQ: return replace_with_integer(fold, node, x != y);
+  case BOP_AND: return replace_with_integer(fold, node, x != 0 && y != 0);
+  case BOP_OR:  return replace_with_integer(fold, node, x != 0 || y != 0);
+  case BOP_LT:  return replace_with_integer(fold, node, x < y);
+  case BOP_LE:  return replace_with_integer(fold, node, x <= y);
+  case BOP_GT:  return replace_with_integer(fold, node, x > y);
+  case BOP_GE:  return replace_with_integer(fold, node, x >= y);
+  default:
+    return node;
+  }
+}
+
+/* algebraic identities with a single constant operand */
+static node_t *fold_identity(fold_t *fold, node_t *node) {
+  node_t *lhs = node_get_child(node, 0);
+  node_t *rhs = node_get_child(node, 1);
+
+  switch (node_get_bop(node)) {
+  case BOP_ADD: /* x + 0, 0 + x */
+    if (is_integer(rhs, 0)) {
+      return replace_with_child(fold, node, 0);
+    }
+    if (is_integer(lhs, 0)) {
+      return replace_with_child(fold, node, 1);
+    }
+    break;
+  case BOP_SUB: /* x - 0 */
+    if (is_integer(rhs, 0)) {
+      return replace_with_child(fold, node, 0);
+    }
+    break;
+  case BOP_MUL: /* x * 1, 1 * x, x * 0, 0 * x */
+    if (is_integer(rhs, 1)) {
+      return replace_with_child(fold, node, 0);
+    }
+    if (is_integer(lhs, 1)) {
+      return replace_with_child(fold, node, 1);
+    }
+    if ((is_integer(rhs, 0) && !node_has_side_effects(lhs)) ||
+        (is_integer(lhs, 0) && !node_has_side_effects(rhs))) {
+      return replace_with_integer(fold, node, 0);
+    }
+    break;
+  case BOP_DIV: /* x / 1 */
+    if (is_integer(rhs, 1)) {
+      return replace_with_child(fold, node, 0);
+    }
+    break;
+  case BOP_MOD: /* x % 1 */
+    if (is_integer(rhs, 1) && !node_has_side_effects(lhs)) {
+      return replace_with_integer(fold, node, 0);
+    }
+    break;
+  case BOP_AND: /* x & 0, 0 & x */
+    if ((is_integer(rhs, 0) && !node_has_side_effects(lhs)) ||
+        (is_integer(lhs, 0) && !node_has_side_effects(rhs))) {
+      return replace_with_integer(fold, node, 0);
+    }
+    break;
+  case BOP_OR: /* x | n, n | x with n != 0 */
+    if ((node_get_ntype(rhs) == NT_INTEGER && !is_integer(rhs, 0) && !node_has_side_effects(lhs)) ||
+        (node_get_ntype(lhs) == NT_INTEGER && !is_integer(lhs, 0) && !node_has_side_effects(rhs))) {
+      return replace_with_integer(fold, node, 1);
+    }
+    break;
+  default:
+    break;
+  }
+
+  return node;
+}
+
+static node_t *replace_with_integer(fold_t *fold, node_t *node, long long value) {
+  /* PUSH takes an int operand */
+  if (value < INT_MIN || value > INT_MAX) {
+    return node;
+  }
+
+  node_set_integer(node, (int)value);
+  ++fold->count;
+  return node;
+}
+
+static node_t *replace_with_child(fold_t *fold, node_t *node, int i) {
+  ++fold->count;
+  return node_get_child(node, i);
+}
+
+static bool is_integer(node_t *node, int value) {
+  return node_get_ntype(node) == NT_INTEGER && node_get_value(node) == value;
+}
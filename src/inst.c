@@ -1,125 +1,181 @@
+#include <stdbool.h>
 #include "inst.h"
 #include "utils/memory.h"
 
-static inst_t *inst_new(opcode_t opcode) {
-  inst_t *inst = (inst_t *)AK_MEM_MALLOC(sizeof(inst_t));
-  inst->opcode = opcode;
+struct insts_t {
+  inst_t *data;
+  int     count;
+  int     capacity;
+};
+
+static inst_t inst_make(opcode_t opcode) {
+  inst_t inst;
+  inst.opcode = opcode;
+  inst.value = 0;
   return inst;
 }
 
-static inst_t *inst_new_with_value(opcode_t opcode, int value) {
-  inst_t *inst = inst_new(opcode);
-  inst->value = value;
+static inst_t inst_make_with_value(opcode_t opcode, int value) {
+  inst_t inst = inst_make(opcode);
+  inst.value = value;
   return inst;
 }
 
-static inst_t *inst_new_with_label(opcode_t opcode, label_t *label) {
-  inst_t *inst = inst_new(opcode);
-  inst->label = label;
+static inst_t inst_make_with_label(opcode_t opcode, int label) {
+  inst_t inst = inst_make(opcode);
+  inst.label = label;
   return inst;
 }
 
-inst_t *inst_new_nop(void) {
-  return inst_new(OP_NOP);
+inst_t inst_nop(void) {
+  return inst_make(OP_NOP);
+}
+
+inst_t inst_push(int value) {
+  return inst_make_with_value(OP_PUSH, value);
+}
+
+inst_t inst_copy(int value) {
+  return inst_make_with_value(OP_COPY, value);
+}
+
+inst_t inst_slide(int value) {
+  return inst_make_with_value(OP_SLIDE, value);
+}
+
+inst_t inst_dup(void) {
+  return inst_make(OP_DUP);
+}
+
+inst_t inst_pop(void) {
+  return inst_make(OP_POP);
+}
+
+inst_t inst_swap(void) {
+  return inst_make(OP_SWAP);
+}
+
+inst_t inst_add(void) {
+  return inst_make(OP_ADD);
 }
 
-inst_t *inst_new_push(int value) {
-  return inst_new_with_value(OP_PUSH, value);
+inst_t inst_sub(void) {
+  return inst_make(OP_SUB);
 }
 
-inst_t *inst_new_copy(int value) {
-  return inst_new_with_value(OP_COPY, value);
+inst_t inst_mul(void) {
+  return inst_make(OP_MUL);
 }
 
-inst_t *inst_new_slide(int value) {
-  return inst_new_with_value(OP_SLIDE, value);
+inst_t inst_div(void) {
+  return inst_make(OP_DIV);
 }
 
-inst_t *inst_new_dup(void) {
-  return inst_new(OP_DUP);
+inst_t inst_mod(void) {
+  return inst_make(OP_MOD);
 }
 
-inst_t *inst_new_pop(void) {
-  return inst_new(OP_POP);
+inst_t inst_store(void) {
+  return inst_make(OP_STORE);
 }
 
-inst_t *inst_new_swap(void) {
-  return inst_new(OP_SWAP);
+inst_t inst_load(void) {
+  return inst_make(OP_LOAD);
 }
 
-inst_t *inst_new_add(void) {
-  return inst_new(OP_ADD);
+inst_t inst_putc(void) {
+  return inst_make(OP_PUTC);
 }
 
-inst_t *inst_new_sub(void) {
-  return inst_new(OP_SUB);
+inst_t inst_puti(void) {
+  return inst_make(OP_PUTI);
 }
 
-inst_t *inst_new_mul(void) {
-  return inst_new(OP_MUL);
+inst_t inst_getc(void) {
+  return inst_make(OP_GETC);
 }
 
-inst_t *inst_new_div(void) {
-  return inst_new(OP_DIV);
+inst_t inst_geti(void) {
+  return inst_make(OP_GETI);
 }
 
-inst_t *inst_new_mod(void) {
-  return inst_new(OP_MOD);
+inst_t inst_label(int label) {
+  return inst_make_with_label(OP_LABEL, label);
 }
 
-inst_t *inst_new_store(void) {
-  return inst_new(OP_STORE);
+inst_t inst_call(int label) {
+  return inst_make_with_label(OP_CALL, label);
 }
 
-inst_t *inst_new_load(void) {
-  return inst_new(OP_LOAD);
+inst_t inst_jmp(int label) {
+  return inst_make_with_label(OP_JMP, label);
 }
 
-inst_t *inst_new_putc(void) {
-  return inst_new(OP_PUTC);
+inst_t inst_jz(int label) {
+  return inst_make_with_label(OP_JZ, label);
 }
 
-inst_t *inst_new_puti(void) {
-  return inst_new(OP_PUTI);
+inst_t inst_jneg(int label) {
+  return inst_make_with_label(OP_JNEG, label);
 }
 
-inst_t *inst_new_getc(void) {
-  return inst_new(OP_GETC);
+inst_t inst_ret(void) {
+  return inst_make(OP_RET);
 }
 
-inst_t *inst_new_geti(void) {
-  return inst_new(OP_GETI);
+inst_t inst_halt(void) {
+  return inst_make(OP_HALT);
 }
 
-inst_t *inst_new_label(label_t *label) {
-  return inst_new_with_label(OP_LABEL, label);
+bool inst_has_label(const inst_t *inst) {
+  switch (inst->opcode) {
+  case OP_LABEL:
+  case OP_CALL:
+  case OP_JMP:
+  case OP_JZ:
+  case OP_JNEG:
+    return true;
+  default:
+    return false;
+  }
 }
 
-inst_t *inst_new_call(label_t *label) {
-  return inst_new_with_label(OP_CALL, label);
+insts_t *insts_new(int initial_capacity) {
+  insts_t *insts = (insts_t *)AK_MEM_MALLOC(sizeof(insts_t));
+  insts->count = 0;
+  insts->capacity = initial_capacity > 0 ? initial_capacity : 1;
+  insts->data = (inst_t *)AK_MEM_MALLOC(sizeof(inst_t) * insts->capacity);
+  return insts;
 }
 
-inst_t *inst_new_jmp(label_t *label) {
-  return inst_new_with_label(OP_JMP, label);
+void insts_release(insts_t **pinsts) {
+  AK_MEM_FREE((*pinsts)->data);
+  AK_MEM_FREE(*pinsts);
+  *pinsts = NULL;
 }
 
-inst_t *inst_new_jz(label_t *label) {
-  return inst_new_with_label(OP_JZ, label);
+void insts_append(insts_t *insts, inst_t inst) {
+  if (insts->count == insts->capacity) {
+    insts->capacity *= 2;
+    insts->data = (inst_t *)AK_MEM_REALLOC(insts->data, sizeof(inst_t) * insts->capacity);
+  }
+  insts->data[insts->count++] = inst;
 }
 
-inst_t *inst_new_jneg(label_t *label) {
-  return inst_new_with_label(OP_JNEG, label);
+int insts_count(insts_t *insts) {
+  return insts->count;
 }
 
-inst_t *inst_new_ret(void) {
-  return inst_new(OP_RET);
+inst_t *insts_get(insts_t *insts, int index) {
+  return &insts->data[index];
 }
 
-inst_t *inst_new_halt(void) {
-  return inst_new(OP_HALT);
+inst_t *insts_data(insts_t *insts) {
+  return insts->data;
 }
 
-void inst_release(inst_t **pinst) {
-  AK_MEM_FREE(*pinst);
-  *pinst = NULL;
+void insts_truncate(insts_t *insts, int count) {
+  if (count < insts->count) {
+    insts->count = count;
+  }
 }
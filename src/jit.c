@@ -0,0 +1,784 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "jit.h"
+#include "inst.h"
+#include "utils/memory.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+#define INITIAL_BUF_CAPACITY ( 4096 )
+#define PAGE_SIZE            ( 4096 )
+#define STACK_SLOTS          ( 1 << 24 )
+#define HEAP_SLOTS           ( 1 << 26 )
+#define CALL_DEPTH_MAX       ( 1 << 18 )
+
+typedef enum {
+  X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+  X86_R8,  X86_R9,  X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15
+} x86_reg_t;
+
+/* exit status of generated code; see g_status_messages */
+typedef enum {
+  STATUS_OK,
+  STATUS_HEAP,
+  STATUS_DIVISION,
+  STATUS_CALL_OVERFLOW,
+  STATUS_RETURN,
+  STATUS_STACK,
+  STATUS_STACK_OVERFLOW,
+  STATUS_INPUT,
+  STATUS_COUNT
+} status_t;
+
+static const char *g_status_messages[] = {
+  [STATUS_OK]            = NULL,
+  [STATUS_HEAP]          = "error: invalid heap address.\n",
+  [STATUS_DIVISION]      = "error: division by zero.\n",
+  [STATUS_CALL_OVERFLOW] = "error: call stack overflow.\n",
+  [STATUS_RETURN]        = "error: return with empty call stack.\n",
+  [STATUS_STACK]         = "error: stack underflow.\n",
+  [STATUS_STACK_OVERFLOW] = "error: stack overflow.\n",
+  [STATUS_INPUT]         = "error: failed to read an integer.\n"
+};
+
+typedef int (*entry_t)(jit_t *jit, int64_t *stack, int64_t *heap);
+
+/*
+ * The Whitespace operand stack lives in memory pointed by r12 with its top
+ * element cached in rax, the heap is a flat array based at r13 and calls map
+ * onto native call/ret with the depth counted in r15. rbx holds the jit_t.
+ * Each straight-line segment checks r12 against stack_bottom and stack_top,
+ * kept in r14, on entry; the guard pages around the operand stack are a last resort.
+ */
+struct jit_t {
+  uint8_t  *buf;
+  int       size;
+  int       capacity;
+  int      *label_offsets;
+  int       label_count;
+  int      *fixups;
+  int       fixup_count;
+  int       fixup_capacity;
+  int       exit_offset;
+  int       stub_offsets[STATUS_COUNT];
+  void     *code;
+  size_t    code_size;
+  uint8_t  *stack_region;
+  int64_t  *heap;
+  void     *saved_rsp;
+  int64_t  *stack_bottom;
+  int64_t  *stack_top;
+  int       error_count;
+};
+
+static void compile(jit_t *jit, insts_t *instructions);
+static int  find_segment(inst_t *code, int count, int start, int *need, int *grow);
+static void emit_stack_check(jit_t *jit, int need, int grow);
+static void emit_inst(jit_t *jit, inst_t *inst);
+static void error(jit_t *jit, const char *fmt, ...);
+
+bool jit_is_available(void) {
+  return true;
+}
+
+jit_t *jit_new(insts_t *instructions) {
+  jit_t *jit = (jit_t *)AK_MEM_CALLOC(1, sizeof(jit_t));
+  size_t stack_size = (size_t)STACK_SLOTS * sizeof(int64_t);
+
+  jit->capacity = INITIAL_BUF_CAPACITY;
+  jit->buf = (uint8_t *)AK_MEM_MALLOC(jit->capacity);
+  jit->fixup_capacity = 64;
+  jit->fixups = (int *)AK_MEM_MALLOC(sizeof(int) * 2 * jit->fixup_capacity);
+
+  compile(jit, instructions);
+
+  jit->code_size = (size_t)jit->size;
+  jit->code = mmap(NULL, jit->code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  jit->stack_region = mmap(NULL, stack_size + 2 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  jit->heap = mmap(NULL, (size_t)HEAP_SLOTS * sizeof(int64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  if (jit->code == MAP_FAILED || jit->stack_region == MAP_FAILED || jit->heap == MAP_FAILED) {
+    error(jit, "error: could not allocate memory for JIT.\n");
+    return jit;
+  }
+
+  memcpy(jit->code, jit->buf, jit->code_size);
+  if (mprotect(jit->code, jit->code_size, PROT_READ | PROT_EXEC) != 0) {
+    error(jit, "error: could not make JIT code executable.\n");
+  }
+  else if (mprotect(jit->stack_region, PAGE_SIZE, PROT_NONE) != 0 ||
+           mprotect(jit->stack_region + PAGE_SIZE + stack_size, PAGE_SIZE, PROT_NONE) != 0) {
+    error(jit, "error: could not protect the JIT stack.\n");
+  }
+
+  return jit;
+}
+
+void jit_release(jit_t **pjit) {
+  jit_t *jit = *pjit;
+  size_t stack_size = (size_t)STACK_SLOTS * sizeof(int64_t);
+
+  if (jit->code && jit->code != MAP_FAILED) {
+    munmap(jit->code, jit->code_size);
+  }
+  if (jit->stack_region && jit->stack_region != MAP_FAILED) {
+    munmap(jit->stack_region, stack_size + 2 * PAGE_SIZE);
+  }
+  if (jit->heap && jit->heap != MAP_FAILED) {
+    munmap(jit->heap, (size_t)HEAP_SLOTS * sizeof(int64_t));
+  }
+  AK_MEM_FREE(jit->buf);
+  AK_MEM_FREE(jit->label_offsets);
+  AK_MEM_FREE(jit->fixups);
+  AK_MEM_FREE(jit);
+  *pjit = NULL;
+}
+
+void jit_run(jit_t *jit) {
+  entry_t entry;
+  int64_t *stack;
+  int status;
+
+  if (jit->error_count > 0) {
+    return;
+  }
+
+  memcpy(&entry, &jit->code, sizeof(entry));
+  stack = (int64_t *)(jit->stack_region + PAGE_SIZE);
+
+  /*
+   * r12 starts one slot below the stack since the first push spills the empty
+   * rax, so with n values on the stack r12 is stack_bottom + n.
+   */
+  jit->stack_bottom = stack - 1;
+  jit->stack_top = stack + STACK_SLOTS - 1;
+  status = entry(jit, jit->stack_bottom, jit->heap);
+  fflush(stdout);
+
+  if (status != STATUS_OK) {
+    error(jit, "%s", g_status_messages[status]);
+  }
+}
+
+int jit_get_error_count(jit_t *jit) {
+  return jit->error_count;
+}
+
+/* runtime helpers called from generated code */
+
+static void helper_putc(int64_t c) {
+  putchar((int)c);
+}
+
+static void helper_puti(int64_t n) {
+  printf("%" PRId64, n);
+}
+
+static void helper_getc(int64_t *cell) {
+  fflush(stdout);
+  *cell = getchar();
+}
+
+static int helper_geti(int64_t *cell) {
+  fflush(stdout);
+  return scanf("%" SCNd64, cell) == 1 ? 0 : 1;
+}
+
+/* machine code emission */
+
+static void emit8(jit_t *jit, int b) {
+  if (jit->size == jit->capacity) {
+    jit->capacity *= 2;
+    jit->buf = (uint8_t *)AK_MEM_REALLOC(jit->buf, jit->capacity);
+  }
+  jit->buf[jit->size++] = (uint8_t)b;
+}
+
+static void emit32(jit_t *jit, int32_t v) {
+  uint32_t u = (uint32_t)v;
+  for (int i = 0; i < 4; ++i) {
+    emit8(jit, (u >> (8 * i)) & 0xFF);
+  }
+}
+
+static void emit64(jit_t *jit, int64_t v) {
+  uint64_t u = (uint64_t)v;
+  for (int i = 0; i < 8; ++i) {
+    emit8(jit, (u >> (8 * i)) & 0xFF);
+  }
+}
+
+static void patch32(jit_t *jit, int pos, int32_t v) {
+  uint32_t u = (uint32_t)v;
+  for (int i = 0; i < 4; ++i) {
+    jit->buf[pos + i] = (u >> (8 * i)) & 0xFF;
+  }
+}
+
+static bool is_imm8(int64_t v) {
+  return v >= -128 && v <= 127;
+}
+
+static bool is_imm32(int64_t v) {
+  return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static void emit_opcode(jit_t *jit, int op) {
+  if (op > 0xFF) {
+    emit8(jit, op >> 8);
+  }
+  emit8(jit, op & 0xFF);
+}
+
+static void emit_rex_w(jit_t *jit, int reg, int index, int base) {
+  emit8(jit, 0x48 | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+}
+
+static void emit_modrm(jit_t *jit, int mod, int reg, int rm) {
+  emit8(jit, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* op reg, rm (register direct) */
+static void emit_rr(jit_t *jit, int op, int reg, int rm) {
+  emit_rex_w(jit, reg, 0, rm);
+  emit_opcode(jit, op);
+  emit_modrm(jit, 3, reg, rm);
+}
+
+/* op reg, [base + disp] */
+static void emit_rm(jit_t *jit, int op, int reg, int base, int32_t disp) {
+  int mod = (disp == 0 && (base & 7) != X86_RBP) ? 0 : is_imm8(disp) ? 1 : 2;
+
+  emit_rex_w(jit, reg, 0, base);
+  emit_opcode(jit, op);
+  emit_modrm(jit, mod, reg, base);
+  if ((base & 7) == X86_RSP) {
+    emit8(jit, 0x24);
+  }
+  if (mod == 1) {
+    emit8(jit, disp & 0xFF);
+  }
+  else if (mod == 2) {
+    emit32(jit, disp);
+  }
+}
+
+/* op reg, [base + index * 8] */
+static void emit_rmi(jit_t *jit, int op, int reg, int base, int index) {
+  bool need_disp = (base & 7) == X86_RBP;
+
+  emit_rex_w(jit, reg, index, base);
+  emit_opcode(jit, op);
+  emit_modrm(jit, need_disp ? 1 : 0, reg, X86_RSP);
+  emit8(jit, (3 << 6) | ((index & 7) << 3) | (base & 7));
+  if (need_disp) {
+    emit8(jit, 0);
+  }
+}
+
+/* group-1 arithmetic with immediate: ext is 0 (add), 4 (and), 5 (sub) or 7 (cmp) */
+static void emit_ri(jit_t *jit, int ext, int reg, int32_t imm) {
+  emit_rex_w(jit, 0, 0, reg);
+  if (is_imm8(imm)) {
+    emit8(jit, 0x83);
+    emit_modrm(jit, 3, ext, reg);
+    emit8(jit, imm & 0xFF);
+  }
+  else {
+    emit8(jit, 0x81);
+    emit_modrm(jit, 3, ext, reg);
+    emit32(jit, imm);
+  }
+}
+
+/* unary group-3/5 operation: F7 /3 (neg), F7 /7 (idiv), FF /0 (inc), FF /1 (dec) */
+static void emit_unary(jit_t *jit, int op, int ext, int reg) {
+  emit_rex_w(jit, 0, 0, reg);
+  emit8(jit, op);
+  emit_modrm(jit, 3, ext, reg);
+}
+
+static void emit_mov_imm(jit_t *jit, int reg, int64_t imm) {
+  if (is_imm32(imm)) {
+    emit_rex_w(jit, 0, 0, reg);
+    emit8(jit, 0xC7);
+    emit_modrm(jit, 3, 0, reg);
+    emit32(jit, (int32_t)imm);
+  }
+  else {
+    emit_rex_w(jit, 0, 0, reg);
+    emit8(jit, 0xB8 + (reg & 7));
+    emit64(jit, imm);
+  }
+}
+
+static void emit_push_reg(jit_t *jit, int reg) {
+  if (reg >= X86_R8) {
+    emit8(jit, 0x41);
+  }
+  emit8(jit, 0x50 + (reg & 7));
+}
+
+static void emit_pop_reg(jit_t *jit, int reg) {
+  if (reg >= X86_R8) {
+    emit8(jit, 0x41);
+  }
+  emit8(jit, 0x58 + (reg & 7));
+}
+
+/* jmp (op == 0xE9), call (0xE8) or jcc (0x0F8x) to a known offset */
+static void emit_jump_to(jit_t *jit, int op, int offset) {
+  emit_opcode(jit, op);
+  emit32(jit, offset - (jit->size + 4));
+}
+
+/* jmp, call or jcc to a label resolved after the whole program is emitted */
+static void emit_jump_label(jit_t *jit, int op, int label) {
+  emit_opcode(jit, op);
+  if (jit->fixup_count == jit->fixup_capacity) {
+    jit->fixup_capacity *= 2;
+    jit->fixups = (int *)AK_MEM_REALLOC(jit->fixups, sizeof(int) * 2 * jit->fixup_capacity);
+  }
+  jit->fixups[2 * jit->fixup_count] = jit->size;
+  jit->fixups[2 * jit->fixup_count + 1] = label;
+  ++jit->fixup_count;
+  emit32(jit, 0);
+}
+
+/* short forward jcc, patched by emit_short_target */
+static int emit_short_jump(jit_t *jit, int op) {
+  emit8(jit, op);
+  emit8(jit, 0);
+  return jit->size;
+}
+
+static void emit_short_target(jit_t *jit, int from) {
+  jit->buf[from - 1] = (uint8_t)(jit->size - from);
+}
+
+/* calls a C function with the native stack aligned to 16 bytes */
+static void emit_call_helper(jit_t *jit, uintptr_t fn) {
+  emit_rr(jit, 0x8B, X86_RBP, X86_RSP);
+  emit_ri(jit, 4, X86_RSP, -16);
+  emit_mov_imm(jit, X86_R11, (int64_t)fn);
+  emit8(jit, 0x41);
+  emit8(jit, 0xFF);
+  emit8(jit, 0xD3);
+  emit_rr(jit, 0x8B, X86_RSP, X86_RBP);
+}
+
+/* push the cached top of stack into memory */
+static void emit_spill(jit_t *jit) {
+  emit_ri(jit, 0, X86_R12, 8);
+  emit_rm(jit, 0x89, X86_RAX, X86_R12, 0);
+}
+
+/* drop the top of stack and reload the next one into rax */
+static void emit_drop(jit_t *jit) {
+  emit_rm(jit, 0x8B, X86_RAX, X86_R12, 0);
+  emit_ri(jit, 5, X86_R12, 8);
+}
+
+static void emit_heap_check(jit_t *jit, int reg) {
+  emit_ri(jit, 7, reg, HEAP_SLOTS);
+  emit_jump_to(jit, 0x0F83, jit->stub_offsets[STATUS_HEAP]);
+}
+
+static void emit_prologue(jit_t *jit) {
+  int jump_to_code;
+
+  emit_push_reg(jit, X86_RBX);
+  emit_push_reg(jit, X86_RBP);
+  emit_push_reg(jit, X86_R12);
+  emit_push_reg(jit, X86_R13);
+  emit_push_reg(jit, X86_R14);
+  emit_push_reg(jit, X86_R15);
+  emit_ri(jit, 5, X86_RSP, 8);
+  emit_rr(jit, 0x8B, X86_RBX, X86_RDI);
+  emit_rr(jit, 0x8B, X86_R12, X86_RSI);
+  emit_rr(jit, 0x8B, X86_R13, X86_RDX);
+  emit_rr(jit, 0x33, X86_R15, X86_R15);
+  emit_rm(jit, 0x8B, X86_R14, X86_RBX, (int32_t)offsetof(jit_t, stack_top));
+  emit_rm(jit, 0x89, X86_RSP, X86_RBX, (int32_t)offsetof(jit_t, saved_rsp));
+  emit8(jit, 0xE9);
+  emit32(jit, 0);
+  jump_to_code = jit->size;
+
+  /* exit with the status in eax, unwinding any native call frames */
+  jit->exit_offset = jit->size;
+  emit_rm(jit, 0x8B, X86_RSP, X86_RBX, (int32_t)offsetof(jit_t, saved_rsp));
+  emit_ri(jit, 0, X86_RSP, 8);
+  emit_pop_reg(jit, X86_R15);
+  emit_pop_reg(jit, X86_R14);
+  emit_pop_reg(jit, X86_R13);
+  emit_pop_reg(jit, X86_R12);
+  emit_pop_reg(jit, X86_RBP);
+  emit_pop_reg(jit, X86_RBX);
+  emit8(jit, 0xC3);
+
+  for (int status = STATUS_HEAP; status < STATUS_COUNT; ++status) {
+    jit->stub_offsets[status] = jit->size;
+    emit8(jit, 0xB8);
+    emit32(jit, status);
+    emit_jump_to(jit, 0xE9, jit->exit_offset);
+  }
+
+  patch32(jit, jump_to_code - 4, jit->size - jump_to_code);
+}
+
+static void emit_exit(jit_t *jit) {
+  emit8(jit, 0x31);
+  emit8(jit, 0xC0);
+  emit_jump_to(jit, 0xE9, jit->exit_offset);
+}
+
+static void compile(jit_t *jit, insts_t *instructions) {
+  int count = insts_count(instructions);
+
+  for (int i = 0; i < count; ++i) {
+    inst_t *inst = insts_get(instructions, i);
+    if (inst_has_label(inst) && inst->label >= jit->label_count) {
+      jit->label_count = inst->label + 1;
+    }
+  }
+
+  jit->label_offsets = (int *)AK_MEM_MALLOC(sizeof(int) * (jit->label_count + 1));
+  for (int i = 0; i < jit->label_count; ++i) {
+    jit->label_offsets[i] = -1;
+  }
+
+  emit_prologue(jit);
+
+  for (int i = 0; i < count; ) {
+    inst_t *code = insts_data(instructions);
+    int need, grow;
+    int end = find_segment(code, count, i, &need, &grow);
+
+    /* jumps land on the check, so it goes after the label */
+    if (code[i].opcode == OP_LABEL) {
+      emit_inst(jit, &code[i++]);
+    }
+    emit_stack_check(jit, need, grow);
+    for (; i < end; ++i) {
+      emit_inst(jit, &code[i]);
+    }
+  }
+  emit_exit(jit);
+
+  for (int i = 0; i < jit->fixup_count; ++i) {
+    int pos = jit->fixups[2 * i];
+    int label = jit->fixups[2 * i + 1];
+    int offset = jit->label_offsets[label];
+
+    if (offset < 0) {
+      error(jit, "error: undefined label L%d.\n", label);
+      continue;
+    }
+    patch32(jit, pos, offset - (pos + 4));
+  }
+}
+
+/* values an instruction reads from the stack and the change of the depth */
+static void stack_change(const inst_t *inst, int *need, int *delta) {
+  int n = inst->value < 0 ? 0 : inst->value > STACK_SLOTS ? STACK_SLOTS : inst->value;
+
+  *need = 0;
+  *delta = 0;
+  switch (inst->opcode) {
+  case OP_PUSH:
+    *delta = 1;
+    break;
+  case OP_COPY:
+    *need = inst->value < 0 ? 0 : n + 1;
+    *delta = 1;
+    break;
+  case OP_SLIDE:
+    *need = n + 1;
+    *delta = -n;
+    break;
+  case OP_DUP:
+    *need = 1;
+    *delta = 1;
+    break;
+  case OP_SWAP:
+    *need = 2;
+    break;
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+    *need = 2;
+    *delta = -1;
+    break;
+  case OP_STORE:
+    *need = 2;
+    *delta = -2;
+    break;
+  case OP_LOAD:
+    *need = 1;
+    break;
+  case OP_POP:
+  case OP_PUTC:
+  case OP_PUTI:
+  case OP_GETC:
+  case OP_GETI:
+  case OP_JZ:
+  case OP_JNEG:
+    *need = 1;
+    *delta = -1;
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * A segment runs from start up to the next label or past the next control
+ * transfer, so it executes straight through. need is the depth it requires
+ * on entry and grow the most it adds on top of that.
+ */
+static int find_segment(inst_t *code, int count, int start, int *need, int *grow) {
+  int64_t depth = 0, low = 0, high = 0;
+  int i = start;
+
+  while (i < count && (i == start || code[i].opcode != OP_LABEL)) {
+    int inst_need, delta;
+    opcode_t opcode = code[i].opcode;
+
+    stack_change(&code[i], &inst_need, &delta);
+    if (inst_need - depth > low) {
+      low = inst_need - depth;
+    }
+    depth += delta;
+    if (depth > high) {
+      high = depth;
+    }
+    ++i;
+    if (opcode == OP_CALL || opcode == OP_JMP || opcode == OP_JZ || opcode == OP_JNEG || opcode == OP_RET || opcode == OP_HALT) {
+      break;
+    }
+  }
+
+  /* anything beyond the stack fails the check, whatever the exact amount */
+  *need = low > STACK_SLOTS ? STACK_SLOTS + 1 : (int)low;
+  *grow = high > STACK_SLOTS ? STACK_SLOTS + 1 : (int)high;
+
+  return i;
+}
+
+static void emit_stack_check(jit_t *jit, int need, int grow) {
+  if (need > STACK_SLOTS) {
+    emit_jump_to(jit, 0xE9, jit->stub_offsets[STATUS_STACK]);
+  }
+  else if (need > 0) {
+    emit_rm(jit, 0x8D, X86_RCX, X86_R12, -8 * need);
+    emit_rm(jit, 0x3B, X86_RCX, X86_RBX, (int32_t)offsetof(jit_t, stack_bottom));
+    emit_jump_to(jit, 0x0F82, jit->stub_offsets[STATUS_STACK]);
+  }
+  if (grow > STACK_SLOTS) {
+    emit_jump_to(jit, 0xE9, jit->stub_offsets[STATUS_STACK_OVERFLOW]);
+  }
+  else if (grow > 0) {
+    emit_rm(jit, 0x8D, X86_RCX, X86_R12, 8 * grow);
+    emit_rr(jit, 0x3B, X86_RCX, X86_R14);
+    emit_jump_to(jit, 0x0F87, jit->stub_offsets[STATUS_STACK_OVERFLOW]);
+  }
+}
+
+static void emit_division(jit_t *jit, opcode_t opcode) {
+  int skip1, skip2;
+
+  emit_rr(jit, 0x8B, X86_RCX, X86_RAX);
+  emit_rr(jit, 0x85, X86_RCX, X86_RCX);
+  emit_jump_to(jit, 0x0F84, jit->stub_offsets[STATUS_DIVISION]);
+  emit_drop(jit);
+  emit8(jit, 0x48);
+  emit8(jit, 0x99);
+  emit_unary(jit, 0xF7, 7, X86_RCX);
+
+  /* round toward negative infinity when the remainder and divisor differ in sign */
+  emit_rr(jit, 0x85, X86_RDX, X86_RDX);
+  skip1 = emit_short_jump(jit, 0x74);
+  emit_rr(jit, 0x8B, X86_R8, X86_RDX);
+  emit_rr(jit, 0x33, X86_R8, X86_RCX);
+  skip2 = emit_short_jump(jit, 0x79);
+  if (opcode == OP_DIV) {
+    emit_unary(jit, 0xFF, 1, X86_RAX);
+  }
+  else {
+    emit_rr(jit, 0x03, X86_RDX, X86_RCX);
+  }
+  emit_short_target(jit, skip1);
+  emit_short_target(jit, skip2);
+
+  if (opcode == OP_MOD) {
+    emit_rr(jit, 0x8B, X86_RAX, X86_RDX);
+  }
+}
+
+static void emit_inst(jit_t *jit, inst_t *inst) {
+  switch (inst->opcode) {
+  case OP_NOP:
+    break;
+  case OP_PUSH:
+    emit_spill(jit);
+    emit_mov_imm(jit, X86_RAX, inst->value);
+    break;
+  case OP_COPY:
+    if (inst->value < 0) {
+      emit_jump_to(jit, 0xE9, jit->stub_offsets[STATUS_STACK]);
+      break;
+    }
+    emit_spill(jit);
+    if (inst->value > 0) {
+      emit_rm(jit, 0x8B, X86_RAX, X86_R12, -8 * inst->value);
+    }
+    break;
+  case OP_SLIDE:
+    if (inst->value > 0) {
+      emit_ri(jit, 5, X86_R12, 8 * inst->value);
+    }
+    break;
+  case OP_DUP:
+    emit_spill(jit);
+    break;
+  case OP_POP:
+    emit_drop(jit);
+    break;
+  case OP_SWAP:
+    emit_rm(jit, 0x8B, X86_RCX, X86_R12, 0);
+    emit_rm(jit, 0x89, X86_RAX, X86_R12, 0);
+    emit_rr(jit, 0x8B, X86_RAX, X86_RCX);
+    break;
+  case OP_ADD:
+    emit_rm(jit, 0x03, X86_RAX, X86_R12, 0);
+    emit_ri(jit, 5, X86_R12, 8);
+    break;
+  case OP_SUB:
+    emit_unary(jit, 0xF7, 3, X86_RAX);
+    emit_rm(jit, 0x03, X86_RAX, X86_R12, 0);
+    emit_ri(jit, 5, X86_R12, 8);
+    break;
+  case OP_MUL:
+    emit_rm(jit, 0x0FAF, X86_RAX, X86_R12, 0);
+    emit_ri(jit, 5, X86_R12, 8);
+    break;
+  case OP_DIV:
+  case OP_MOD:
+    emit_division(jit, inst->opcode);
+    break;
+  case OP_STORE:
+    emit_rm(jit, 0x8B, X86_RCX, X86_R12, 0);
+    emit_heap_check(jit, X86_RCX);
+    emit_rmi(jit, 0x89, X86_RAX, X86_R13, X86_RCX);
+    emit_rm(jit, 0x8B, X86_RAX, X86_R12, -8);
+    emit_ri(jit, 5, X86_R12, 16);
+    break;
+  case OP_LOAD:
+    emit_heap_check(jit, X86_RAX);
+    emit_rmi(jit, 0x8B, X86_RAX, X86_R13, X86_RAX);
+    break;
+  case OP_PUTC:
+    emit_rr(jit, 0x8B, X86_RDI, X86_RAX);
+    emit_call_helper(jit, (uintptr_t)helper_putc);
+    emit_drop(jit);
+    break;
+  case OP_PUTI:
+    emit_rr(jit, 0x8B, X86_RDI, X86_RAX);
+    emit_call_helper(jit, (uintptr_t)helper_puti);
+    emit_drop(jit);
+    break;
+  case OP_GETC:
+    emit_heap_check(jit, X86_RAX);
+    emit_rmi(jit, 0x8D, X86_RDI, X86_R13, X86_RAX);
+    emit_call_helper(jit, (uintptr_t)helper_getc);
+    emit_drop(jit);
+    break;
+  case OP_GETI:
+    emit_heap_check(jit, X86_RAX);
+    emit_rmi(jit, 0x8D, X86_RDI, X86_R13, X86_RAX);
+    emit_call_helper(jit, (uintptr_t)helper_geti);
+    emit8(jit, 0x85);
+    emit8(jit, 0xC0);
+    emit_jump_to(jit, 0x0F85, jit->stub_offsets[STATUS_INPUT]);
+    emit_drop(jit);
+    break;
+  case OP_LABEL:
+    jit->label_offsets[inst->label] = jit->size;
+    break;
+  case OP_CALL:
+    emit_unary(jit, 0xFF, 0, X86_R15);
+    emit_ri(jit, 7, X86_R15, CALL_DEPTH_MAX);
+    emit_jump_to(jit, 0x0F8F, jit->stub_offsets[STATUS_CALL_OVERFLOW]);
+    emit_jump_label(jit, 0xE8, inst->label);
+    break;
+  case OP_JMP:
+    emit_jump_label(jit, 0xE9, inst->label);
+    break;
+  case OP_JZ:
+  case OP_JNEG:
+    emit_rr(jit, 0x8B, X86_RCX, X86_RAX);
+    emit_drop(jit);
+    emit_rr(jit, 0x85, X86_RCX, X86_RCX);
+    emit_jump_label(jit, inst->opcode == OP_JZ ? 0x0F84 : 0x0F88, inst->label);
+    break;
+  case OP_RET:
+    emit_unary(jit, 0xFF, 1, X86_R15);
+    emit_jump_to(jit, 0x0F88, jit->stub_offsets[STATUS_RETURN]);
+    emit8(jit, 0xC3);
+    break;
+  case OP_HALT:
+    emit_exit(jit);
+    break;
+  }
+}
+
+#else
+
+struct jit_t {
+  int error_count;
+};
+
+static void error(jit_t *jit, const char *fmt, ...);
+
+bool jit_is_available(void) {
+  return false;
+}
+
+jit_t *jit_new(insts_t *instructions) {
+  jit_t *jit = (jit_t *)AK_MEM_MALLOC(sizeof(jit_t));
+  jit->error_count = 0;
+  return jit;
+}
+
+void jit_release(jit_t **pjit) {
+  AK_MEM_FREE(*pjit);
+  *pjit = NULL;
+}
+
+void jit_run(jit_t *jit) {
+  error(jit, "error: JIT is not available on this platform.\n");
+}
+
+int jit_get_error_count(jit_t *jit) {
+  return jit->error_count;
+}
+
+#endif
+
+static void error(jit_t *jit, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  jit->error_count++;
+}
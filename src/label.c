@@ -1,70 +1,113 @@
 #include "label.h"
-#include "utils/array.h"
 #include "utils/memory.h"
 
-struct label_t {
-  int      id;
-  label_t *parent;
-};
-
+/*
+ * A disjoint-set forest over the ids first .. first + count - 1. A label is
+ * its own parent until unified; ranks bound the height of the trees.
+ */
 struct ltable_t {
-  array_t *labels;
+  int           *parents;
+  unsigned char *ranks;
+  int            first;
+  int            count;
+  int            capacity;
 };
 
-ltable_t *ltable_new(void) {
+static ltable_t *ltable_new_from(int first) {
   ltable_t *ltable = (ltable_t *)AK_MEM_MALLOC(sizeof(ltable_t));
-  ltable->labels = array_new(64);
+  ltable->first = first;
+  ltable->count = 0;
+  ltable->capacity = 64;
+  ltable->parents = (int *)AK_MEM_MALLOC(sizeof(int) * ltable->capacity);
+  ltable->ranks = (unsigned char *)AK_MEM_MALLOC(sizeof(unsigned char) * ltable->capacity);
   return ltable;
 }
 
-void ltable_release(ltable_t **pltable) {
-  ltable_t *ltable = *pltable;
+ltable_t *ltable_new(void) {
+  return ltable_new_from(0);
+}
 
-  for (int i = 0; i < array_count(ltable->labels); ++i) {
-    label_t *label = (label_t *)array_get(ltable->labels, i);
-    AK_MEM_FREE(label);
-  }
-  array_release(&ltable->labels);
+/* an empty table whose ids follow those already allocated in ltable */
+ltable_t *ltable_new_after(ltable_t *ltable) {
+  return ltable_new_from(ltable->first + ltable->count);
+}
 
-  AK_MEM_FREE(ltable);
+void ltable_release(ltable_t **pltable) {
+  AK_MEM_FREE((*pltable)->parents);
+  AK_MEM_FREE((*pltable)->ranks);
+  AK_MEM_FREE(*pltable);
   *pltable = NULL;
 }
 
-label_t *ltable_alloc(ltable_t *ltable) {
-  int id = array_count(ltable->labels);
-  label_t *label = (label_t *)AK_MEM_MALLOC(sizeof(label_t));
-  label->id = id;
-  label->parent = NULL;
-  array_append(ltable->labels, label);
-  return label;
-}
+int ltable_alloc(ltable_t *ltable) {
+  int label = ltable->first + ltable->count;
 
-label_t *ltable_get(ltable_t *ltable, int id) {
-  return (label_t *)array_get(ltable->labels, id);
+  if (ltable->count == ltable->capacity) {
+    ltable->capacity *= 2;
+    ltable->parents = (int *)AK_MEM_REALLOC(ltable->parents, sizeof(int) * ltable->capacity);
+    ltable->ranks = (unsigned char *)AK_MEM_REALLOC(ltable->ranks, sizeof(unsigned char) * ltable->capacity);
+  }
+  ltable->parents[ltable->count] = label;
+  ltable->ranks[ltable->count] = 0;
+  ltable->count++;
+  return label;
 }
 
 int ltable_count(ltable_t *ltable) {
-  return array_count(ltable->labels);
+  return ltable->count;
 }
 
-static label_t *get_root(label_t *label) {
-  label_t *l = label;
-  while (l->parent) {
-    l = l->parent;
+/*
+ * Move the labels of other to the end of ltable, leaving other empty. Returns
+ * the amount added to each of other's ids, which the caller applies to the
+ * instructions referring to them.
+ */
+int ltable_append(ltable_t *ltable, ltable_t *other) {
+  int shift = ltable->first + ltable->count - other->first;
+
+  for (int i = 0; i < other->count; ++i) {
+    int parent = other->parents[i];
+    ltable_alloc(ltable);
+    ltable->parents[ltable->count - 1] = parent >= other->first ? parent + shift : parent;
+    ltable->ranks[ltable->count - 1] = other->ranks[i];
   }
-  return l;
+  other->first += other->count;
+  other->count = 0;
+  return shift;
 }
 
-void label_unify(label_t *label1, label_t *label2) {
-  label1 = get_root(label1);
-  label2 = get_root(label2);
-  label2->parent = label1;
-}
+/* union by rank: the shorter tree goes under the root of the taller one */
+void ltable_unify(ltable_t *ltable, int label1, int label2) {
+  int root1 = ltable_find(ltable, label1) - ltable->first;
+  int root2 = ltable_find(ltable, label2) - ltable->first;
 
-int label_get_id(label_t *label) {
-  return label->id;
+  if (root1 == root2) {
+    return;
+  }
+  if (ltable->ranks[root1] < ltable->ranks[root2]) {
+    int t = root1;
+    root1 = root2;
+    root2 = t;
+  }
+  ltable->parents[root2] = root1 + ltable->first;
+  if (ltable->ranks[root1] == ltable->ranks[root2]) {
+    ltable->ranks[root1]++;
+  }
 }
 
-int label_get_unified_id(label_t *label) {
-  return get_root(label)->id;
+/* the root of the label's set; the path walked is compressed to point at it */
+int ltable_find(ltable_t *ltable, int label) {
+  int *parents = ltable->parents;
+  int first = ltable->first;
+  int root = label;
+
+  while (parents[root - first] != root) {
+    root = parents[root - first];
+  }
+  while (parents[label - first] != root) {
+    int next = parents[label - first];
+    parents[label - first] = root;
+    label = next;
+  }
+  return root;
 }
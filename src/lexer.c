@@ -1,49 +1,67 @@
 #include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "lexer.h"
 #include "utils/memory.h"
+#include "utils/scan.h"
 
-#define TEXT_BUF_SIZE   ( 64 )
-#define TEXT_LEN_MAX    ( TEXT_BUF_SIZE - 1 )
-
+/*
+ * The lexer runs over a source buffer which must outlive it. Tokens are
+ * slices of the buffer (or of a static string for EOF and unknown tokens),
+ * so nothing is copied.
+ */
 struct lexer_t {
-  FILE      *input;
-  int        cur;
-  location_t location;
-  int        bufpos;
-  char       text[TEXT_BUF_SIZE];
-  ttype_t    ttype;
-  int        ivalue;
-  int        error_count;
+  const char      *cur;
+  const char      *end;
+  location_t       location;
+  const char      *text;
+  int              length;
+  ttype_t          ttype;
+  int              ivalue;
+  int              error_count;
+  location_t       error_location;
+  const scanner_t *scanner;
 };
 
 struct keyword_t {
   const char *keyword;
+  int         length;
   ttype_t     ttype;
 };
 
-static const struct keyword_t g_keywords[] = {
-  { "if",       TT_KW_IF       },
-  { "else",     TT_KW_ELSE     },
-  { "while",    TT_KW_WHILE    },
-  { "loop",     TT_KW_LOOP     },
-  { "for",      TT_KW_FOR      },
-  { "break",    TT_KW_BREAK    },
-  { "continue", TT_KW_CONTINUE },
-  { "puti",     TT_KW_PUTI     },
-  { "putc",     TT_KW_PUTC     },
-  { "geti",     TT_KW_GETI     },
-  { "getc",     TT_KW_GETC     },
-  { "array",    TT_KW_ARRAY    },
-  { "halt",     TT_KW_HALT     },
-  { "func",     TT_KW_FUNC     },
-  { "return",   TT_KW_RETURN   },
-  { "const",    TT_KW_CONST    },
+/*
+ * Keywords are found with a perfect hash of the length and the first and
+ * last characters, so an identifier costs one table probe and at most one
+ * memcmp. The multipliers were picked so that no two keywords collide;
+ * check that again when adding a keyword.
+ */
+#define KEYWORD_TABLE_SIZE ( 32 )
+#define KEYWORD_MIN_LENGTH ( 2 )
+#define KEYWORD_MAX_LENGTH ( 8 )
+#define KEYWORD_HASH(length, first, last) \
+  ((((length) * 2) + ((first) * 12) + (last)) & (KEYWORD_TABLE_SIZE - 1))
+
+static const struct keyword_t g_keywords[KEYWORD_TABLE_SIZE] = {
+  [KEYWORD_HASH(2, 'i', 'f')] = { "if",       2, TT_KW_IF        },
+  [KEYWORD_HASH(4, 'e', 'e')] = { "else",     4, TT_KW_ELSE      },
+  [KEYWORD_HASH(5, 'w', 'e')] = { "while",    5, TT_KW_WHILE     },
+  [KEYWORD_HASH(4, 'l', 'p')] = { "loop",     4, TT_KW_LOOP      },
+  [KEYWORD_HASH(3, 'f', 'r')] = { "for",      3, TT_KW_FOR       },
+  [KEYWORD_HASH(5, 'b', 'k')] = { "break",    5, TT_KW_BREAK     },
+  [KEYWORD_HASH(8, 'c', 'e')] = { "continue", 8, TT_KW_CONTINUE  },
+  [KEYWORD_HASH(4, 'p', 'i')] = { "puti",     4, TT_KW_PUTI      },
+  [KEYWORD_HASH(4, 'p', 'c')] = { "putc",     4, TT_KW_PUTC      },
+  [KEYWORD_HASH(4, 'g', 'i')] = { "geti",     4, TT_KW_GETI      },
+  [KEYWORD_HASH(4, 'g', 'c')] = { "getc",     4, TT_KW_GETC      },
+  [KEYWORD_HASH(5, 'a', 'y')] = { "array",    5, TT_KW_ARRAY     },
+  [KEYWORD_HASH(4, 'h', 't')] = { "halt",     4, TT_KW_HALT      },
+  [KEYWORD_HASH(4, 'f', 'c')] = { "func",     4, TT_KW_FUNC      },
+  [KEYWORD_HASH(6, 'r', 'n')] = { "return",   6, TT_KW_RETURN    },
+  [KEYWORD_HASH(5, 'c', 't')] = { "const",    5, TT_KW_CONST     },
 };
-static const int g_keyword_count = sizeof(g_keywords) / sizeof(struct keyword_t);
 
 static const char g_esc_chars[256] = {
   ['a'] = '\a',
@@ -59,32 +77,39 @@ static const char g_esc_chars[256] = {
 static int  peek(lexer_t *lexer);
 static void succ(lexer_t *lexer);
 
-static void clear_buf(lexer_t *lexer) {
-  memset(lexer->text, 0, TEXT_BUF_SIZE);
-  lexer->bufpos = 0;
+/* an operator has just been consumed, so its spelling ends at the cursor */
+static void set_token(lexer_t *lexer, ttype_t ttype, const char *text) {
+  lexer->ttype = ttype;
+  lexer->length = (int)strlen(text);
+  lexer->text = lexer->cur - lexer->length;
 }
 
-static void append_char(lexer_t *lexer, int c) {
-  if (lexer->bufpos < TEXT_LEN_MAX) {
-    lexer->text[lexer->bufpos++] = (char)c;
-  }
-  else {
-    fprintf(stderr, "too long text.\n");
-  }
+/* EOF and unknown tokens have no text in the source */
+static void set_placeholder(lexer_t *lexer, ttype_t ttype, const char *text) {
+  lexer->ttype = ttype;
+  lexer->text = text;
+  lexer->length = (int)strlen(text);
 }
 
-static void set_token(lexer_t *lexer, ttype_t ttype, const char *text) {
-  lexer->ttype = ttype;
-  strcpy(lexer->text, text);
+/* the token text runs from start to the current position */
+static void set_text(lexer_t *lexer, const char *start) {
+  lexer->text = start;
+  lexer->length = (int)(lexer->cur - start);
 }
 
-lexer_t *lexer_new(FILE *input) {
+lexer_t *lexer_new(const char *src, size_t length) {
   lexer_t *lexer = (lexer_t *)AK_MEM_MALLOC(sizeof(lexer_t));
-  lexer->input = input;
+  lexer->cur = src;
+  lexer->end = src + length;
   lexer->location.column = 1;
   lexer->location.line = 1;
-  lexer->cur = getc(input);
+  lexer->text = "";
+  lexer->length = 0;
+  lexer->ttype = TT_UNKNOWN;
+  lexer->ivalue = 0;
   lexer->error_count = 0;
+  lexer->error_location = lexer->location;
+  lexer->scanner = scanner_get();
   return lexer;
 }
 
@@ -94,7 +119,7 @@ void lexer_release(lexer_t **plexer) {
 }
 
 int lexer_is_eof(lexer_t *lexer) {
-  return lexer->cur == EOF;
+  return lexer->cur == lexer->end;
 }
 
 location_t lexer_get_location(lexer_t *lexer) {
@@ -109,60 +134,82 @@ int lexer_int_value(lexer_t *lexer) {
   return lexer->ivalue;
 }
 
+/* not NUL-terminated, see lexer_text_length */
 const char *lexer_text(lexer_t *lexer) {
   return lexer->text;
 }
 
+int lexer_text_length(lexer_t *lexer) {
+  return lexer->length;
+}
+
 int lexer_get_error_count(lexer_t *lexer) {
   return lexer->error_count;
 }
 
+location_t lexer_get_error_location(lexer_t *lexer) {
+  return lexer->error_location;
+}
+
 static int peek(lexer_t *lexer) {
-  return lexer->cur;
+  return lexer->cur < lexer->end ? (unsigned char)*lexer->cur : EOF;
 }
 
 static void succ(lexer_t *lexer) {
-  if (lexer->cur == EOF) {
+  if (lexer->cur == lexer->end) {
     return;
   }
-  else if (lexer->cur == '\n') {
+  else if (*lexer->cur == '\n') {
     ++lexer->location.line;
     lexer->location.column = 1;
   }
   else {
     ++lexer->location.column;
   }
-  lexer->cur = getc(lexer->input);
-}
-
-void skip_to_end_of_line(lexer_t *lexer) {
-  while (!lexer_is_eof(lexer) && peek(lexer) != '\n') {
-    succ(lexer);
-  }
+  ++lexer->cur;
 }
 
+/* skip whitespace and comments a block at a time, then fix up the location */
 void lexer_skip_ws(lexer_t *lexer) {
-  while (!lexer_is_eof(lexer)) {
-    if (isspace(peek(lexer))) {
-      succ(lexer);
-    }
-    else if (peek(lexer) == '#') {
-      skip_to_end_of_line(lexer);
-    }
-    else {
+  const char *p = lexer->cur;
+  const char *line_start = NULL;
+  int lines = 0;
+
+  for (;;) {
+    p = lexer->scanner->skip_space(p, lexer->end, &lines, &line_start);
+    if (p == lexer->end || *p != '#') {
       break;
     }
+    p = lexer->scanner->find_newline(p, lexer->end);
   }
+
+  if (lines > 0) {
+    lexer->location.line += lines;
+    lexer->location.column = 1 + (int)(p - line_start);
+  }
+  else {
+    lexer->location.column += (int)(p - lexer->cur);
+  }
+  lexer->cur = p;
 }
 
 static void lexer_lex_integer(lexer_t *lexer) {
-  clear_buf(lexer);
+  const char *start = lexer->cur;
+  long value = 0;
+
   while (isdigit(peek(lexer))) {
-    append_char(lexer, peek(lexer));
+    /* saturate like atoi does for out of range literals */
+    if (value <= (LONG_MAX - 9) / 10) {
+      value = value * 10 + (peek(lexer) - '0');
+    }
+    else {
+      value = LONG_MAX;
+    }
     succ(lexer);
   }
+  set_text(lexer, start);
   lexer->ttype = TT_INTEGER;
-  lexer->ivalue = atoi(lexer->text);
+  lexer->ivalue = (int)value;
 }
 
 static int hex_char_to_int(char x) {
@@ -201,6 +248,7 @@ static int lex_escaped_char(lexer_t *lexer) {
 }
 
 static void lex_char(lexer_t *lexer) {
+  const char *start = lexer->cur;
   int c = 0;
 
   if (peek(lexer) == '\'') {
@@ -220,6 +268,7 @@ static void lex_char(lexer_t *lexer) {
     succ(lexer);
   }
 
+  set_text(lexer, start);
   lexer->ttype = TT_CHAR;
   lexer->ivalue = c;
 }
@@ -233,22 +282,23 @@ static bool is_symbol_part(int c) {
 }
 
 void lexer_lex_symbol(lexer_t *lexer) {
-  int i;
+  const char *start = lexer->cur;
+  const struct keyword_t *kw;
 
-  clear_buf(lexer);
   while (is_symbol_part(peek(lexer))) {
-    append_char(lexer, peek(lexer));
     succ(lexer);
   }
+  set_text(lexer, start);
 
   lexer->ttype = TT_SYMBOL;
 
-  for (i = 0; i < g_keyword_count; ++i) {
-    struct keyword_t kw = g_keywords[i];
-    if (strcmp(lexer->text, kw.keyword) == 0) {
-      lexer->ttype = kw.ttype;
-      break;
-    }
+  if (lexer->length < KEYWORD_MIN_LENGTH || lexer->length > KEYWORD_MAX_LENGTH) {
+    return;
+  }
+
+  kw = &g_keywords[KEYWORD_HASH(lexer->length, (unsigned char)start[0], (unsigned char)start[lexer->length - 1])];
+  if (kw->length == lexer->length && memcmp(start, kw->keyword, kw->length) == 0) {
+    lexer->ttype = kw->ttype;
   }
 }
 
@@ -365,7 +415,7 @@ void lexer_next(lexer_t *lexer) {
   c = peek(lexer);
 
   if (c == EOF) {
-    set_token(lexer, TT_EOF, "<EOF>");
+    set_placeholder(lexer, TT_EOF, "<EOF>");
     return;
   }
 
@@ -385,8 +435,10 @@ void lexer_next(lexer_t *lexer) {
     return;
   }
 
-  fprintf(stderr, "error: unrecognizable character '%c' (line:%d,column:%d)\n", c, lexer->location.line, lexer->location.column);
-  set_token(lexer, TT_UNKNOWN, "<UNKNOWN>");
+  /* left to the consumer to report, with the character as the token's value */
+  lexer->ivalue = c;
+  lexer->error_location = lexer->location;
+  set_placeholder(lexer, TT_UNKNOWN, "<UNKNOWN>");
   succ(lexer);
   ++lexer->error_count;
 }
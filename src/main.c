@@ -2,38 +2,72 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "akarin.h"
 #include "parser.h"
 #include "codegen.h"
 #include "node_formatter.h"
 #include "inst.h"
 #include "emitter_ws.h"
 #include "emitter_pseudo.h"
+#include "emitter_c.h"
+#include "vm.h"
+#include "jit.h"
 #include "utils/memory.h"
-#include "utils/array.h"
+#include "utils/symbol.h"
+#include "utils/sink.h"
+#include "utils/source.h"
+#include "utils/pool.h"
 
 typedef enum {
   EMIT_WHITESPACE,
   EMIT_SYMBOLIC,
   EMIT_MIXED,
-  EMIT_PSEUDO_CODE
+  EMIT_PSEUDO_CODE,
+  EMIT_C
 } emit_mode_t;
 
 typedef struct {
-  FILE       *input;
-  bool        dump_tree;
-  emit_mode_t emit_mode;
+  const char **input_paths;
+  int          input_count;
+  const char  *output_dir;
+  int          jobs;
+  bool         dump_tree;
+  bool         run;
+  bool         jit;
+  bool         verbose;
+  int          optimize;
+  emit_mode_t  emit_mode;
 } option_t;
 
+/*
+ * Shared by the tasks of a multi-file run, one error count and one buffer
+ * of diagnostics per input, printed in input order once all are done.
+ */
+typedef struct {
+  const option_t *opt;
+  int            *error_counts;
+  sink_t        **messages;
+} batch_t;
+
 static void show_help(void) {
   printf("\x1B[1mAkarin\x1B[0m - A Whitespace Transpiler\n\n");
-  printf("Usage: akarin [options] [input file]\n\n");
-  printf("Read from standard input if no input file was given.\n\n");
+  printf("Usage: akarin [options] [input file...]\n\n");
+  printf("Read from standard input if no input file was given.\n");
+  printf("With several input files or -o, each output is written to a file named\n");
+  printf("after its source, next to it or in the -o directory.\n\n");
   printf("Options:\n");
   printf("    -h              Show this help.\n");
   printf("    -s              Transpile into symbolic (S, T, L) code instead of whitespace.\n");
   printf("    -m              Transpile into whitespace with S, T, L symbols.\n");
   printf("    -p              Transpile into pseudo mnemonic code instead of whitespace.\n");
+  printf("    -c              Transpile into C source code instead of whitespace.\n");
   printf("    -d              Dump syntax tree.\n");
+  printf("    -O0, -O1        Disable or enable optimizations (default: -O0).\n");
+  printf("    -v              Report optimization statistics to standard error.\n");
+  printf("    -r              Run on the built-in virtual machine instead of transpiling.\n");
+  printf("    -x              Run as native code compiled by the x86-64 JIT instead of transpiling.\n");
+  printf("    -j N            Compile up to N input files, or the functions of one file, in parallel.\n");
+  printf("    -o DIR          Write output files to DIR.\n");
 }
 
 static void process_options(int argc, char *argv[], option_t *opt) {
@@ -51,14 +85,45 @@ static void process_options(int argc, char *argv[], option_t *opt) {
     else if (strcmp(argv[i], "-p") == 0) {
       opt->emit_mode = EMIT_PSEUDO_CODE;
     }
+    else if (strcmp(argv[i], "-c") == 0) {
+      opt->emit_mode = EMIT_C;
+    }
     else if (strcmp(argv[i], "-d") == 0) {
       opt->dump_tree = true;
     }
-    else {
-      if (opt->input == stdin) {
-	opt->input = fopen(argv[i], "r");
+    else if (strcmp(argv[i], "-O0") == 0) {
+      opt->optimize = 0;
+    }
+    else if (strcmp(argv[i], "-O1") == 0) {
+      opt->optimize = 1;
+    }
+    else if (strcmp(argv[i], "-v") == 0) {
+      opt->verbose = true;
+    }
+    else if (strcmp(argv[i], "-r") == 0) {
+      opt->run = true;
+    }
+    else if (strcmp(argv[i], "-x") == 0) {
+      if (jit_is_available()) {
+        opt->jit = true;
+      }
+      else {
+        fprintf(stderr, "warning: JIT is not available on this platform, running the interpreter.\n");
+        opt->run = true;
       }
     }
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      opt->jobs = atoi(argv[++i]);
+      if (opt->jobs < 1) {
+        opt->jobs = 1;
+      }
+    }
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      opt->output_dir = argv[++i];
+    }
+    else {
+      opt->input_paths[opt->input_count++] = argv[i];
+    }
   }
 }
 
@@ -70,26 +135,87 @@ static emitter_t *create_emitter(emit_mode_t emit_mode) {
     return emitter_ws_new("S ", "T\t", "L\n", true);
   case EMIT_PSEUDO_CODE:
     return emitter_pseudo_new(8);
+  case EMIT_C:
+    return emitter_c_new();
   default:
     return emitter_ws_new(" ", "\t", "\n", true);
   }
 }
 
-static void emit_code(array_t *insts, emit_mode_t emit_mode) {
-  emitter_t *emitter = create_emitter(emit_mode);
-  emitter_emit_code(emitter, insts);
+static const char *output_extension(emit_mode_t emit_mode) {
+  switch (emit_mode) {
+  case EMIT_PSEUDO_CODE:
+    return ".wsa";
+  case EMIT_C:
+    return ".c";
+  default:
+    return ".ws";
+  }
+}
+
+/* standard output if output_path is NULL */
+static int emit_code(insts_t *insts, emit_mode_t emit_mode, const char *output_path, sink_t *messages) {
+  emitter_t *emitter;
+  sink_t *sink;
+  FILE *fp = output_path ? fopen(output_path, "wb") : stdout;
+
+  if (!fp) {
+    sink_printf(messages, "error: could not open file - %s\n", output_path);
+    return 1;
+  }
+
+  emitter = create_emitter(emit_mode);
+  sink = sink_new_file(fp);
+  emitter_emit_code(emitter, insts, sink);
+  sink_release(&sink);
   emitter_release(&emitter);
+
+  if (fp != stdout) {
+    fclose(fp);
+  }
+  return 0;
+}
+
+static int run_code(insts_t *insts) {
+  vm_t *vm = vm_new(insts);
+  int error_count;
+
+  vm_run(vm);
+  error_count = vm_get_error_count(vm);
+  vm_release(&vm);
+
+  return error_count;
+}
+
+static int run_jit_code(insts_t *insts) {
+  jit_t *jit = jit_new(insts);
+  int error_count;
+
+  jit_run(jit);
+  error_count = jit_get_error_count(jit);
+  jit_release(&jit);
+
+  return error_count;
 }
 
-static int generate_code(node_t *node, emit_mode_t emit_mode) {
-  codegen_t *codegen = codegen_new(node);
+static int generate_code(node_t *node, const option_t *opt, const char *output_path, sink_t *messages) {
+  codegen_t *codegen;
   int error_count;
 
-  codegen_generate(codegen);
+  /* with several input files the files themselves are compiled in parallel */
+  codegen = akarin_generate(node, opt->optimize, opt->input_count > 1 ? 1 : opt->jobs, opt->verbose, messages);
   error_count = codegen_get_error_count(codegen);
 
   if (error_count == 0) {
-    emit_code(codegen_get_instructions(codegen), emit_mode);
+    if (opt->jit) {
+      error_count = run_jit_code(codegen_get_instructions(codegen));
+    }
+    else if (opt->run) {
+      error_count = run_code(codegen_get_instructions(codegen));
+    }
+    else {
+      error_count = emit_code(codegen_get_instructions(codegen), opt->emit_mode, output_path, messages);
+    }
   }
 
   codegen_release(&codegen);
@@ -97,48 +223,150 @@ static int generate_code(node_t *node, emit_mode_t emit_mode) {
   return error_count;
 }
 
-static node_t *parse(FILE *input, int *error_count) {
-  parser_t *parser = parser_new(input);
-  node_t *node = parser_parse(parser);
-  *error_count += parser_get_total_error_count(parser);
-  parser_release(&parser);
-  return node;
+/* the source's file name with the extension replaced, in output_dir if given */
+static char *make_output_path(const char *input_path, const char *output_dir, emit_mode_t emit_mode) {
+  const char *base = strrchr(input_path, '/') ? strrchr(input_path, '/') + 1 : input_path;
+  const char *ext = strrchr(base, '.');
+  const char *suffix = output_extension(emit_mode);
+  size_t dir_length = output_dir ? strlen(output_dir) : (size_t)(base - input_path);
+  size_t base_length = ext && ext != base ? (size_t)(ext - base) : strlen(base);
+  char *path = (char *)AK_MEM_MALLOC(dir_length + 1 + base_length + strlen(suffix) + 1);
+  char *p = path;
+
+  if (output_dir) {
+    memcpy(p, output_dir, dir_length);
+    p += dir_length;
+    if (dir_length > 0 && output_dir[dir_length - 1] != '/') {
+      *p++ = '/';
+    }
+  }
+  else {
+    memcpy(p, input_path, dir_length);
+    p += dir_length;
+  }
+  memcpy(p, base, base_length);
+  p += base_length;
+  strcpy(p, suffix);
+
+  return path;
 }
 
-int main(int argc, char *argv[]) {
-  option_t opt = { .input = stdin, .dump_tree = false, .emit_mode = EMIT_WHITESPACE };
+/*
+ * Compile one source, reading standard input if input_path is NULL. The
+ * code goes to output_path, or to standard output if that is NULL, and the
+ * diagnostics to messages.
+ */
+static int compile(const option_t *opt, const char *input_path, const char *output_path, sink_t *messages) {
+  source_t *source = input_path ? source_open(input_path) : source_read(stdin);
+  parser_t *parser;
   node_t *node;
   int error_count = 0;
 
-  /* process command line args */
-  process_options(argc, argv, &opt);
-
-  if (!opt.input) {
-    fprintf(stderr, "error: could not open file - %s\n", argv[1]);
+  if (!source) {
+    sink_printf(messages, "error: could not open file - %s\n", input_path);
     return 1;
   }
 
-  node = parse(opt.input, &error_count);
+  /* the syntax tree lives as long as the parser */
+  parser = parser_new(source_get_data(source), source_get_size(source));
+  parser_set_messages(parser, messages);
+  node = parser_parse(parser);
+  error_count += parser_get_total_error_count(parser);
 
-  if (opt.input != stdin) {
-    fclose(opt.input);
-    opt.input = NULL;
-  }
+  source_release(&source);
 
   if (error_count == 0) {
-    if (opt.dump_tree) {
+    if (opt->dump_tree) {
       node_dump_tree(node);
     }
     else {
-      error_count = generate_code(node, opt.emit_mode);
+      error_count = generate_code(node, opt, output_path, messages);
     }
   }
 
   if (error_count > 0) {
-    fprintf(stderr, "%d errors found.\n", error_count);
+    sink_printf(messages, "%d errors found.\n", error_count);
+  }
+
+  parser_release(&parser);
+
+  return error_count;
+}
+
+/* every line of the diagnostics of one input, prefixed with its path */
+static void print_messages(const char *input_path, sink_t *messages) {
+  const char *p = sink_get_data(messages);
+  const char *end = p + sink_get_size(messages);
+
+  while (p < end) {
+    const char *eol = memchr(p, '\n', end - p);
+    int length = eol ? (int)(eol - p) : (int)(end - p);
+
+    fprintf(stderr, "%s: %.*s\n", input_path, length, p);
+    p += length + 1;
+  }
+}
+
+static void compile_task(void *context, int index) {
+  batch_t *batch = (batch_t *)context;
+  const option_t *opt = batch->opt;
+  const char *input_path = opt->input_paths[index];
+  char *output_path = make_output_path(input_path, opt->output_dir, opt->emit_mode);
+
+  batch->messages[index] = sink_new_memory();
+  batch->error_counts[index] = compile(opt, input_path, output_path, batch->messages[index]);
+
+  AK_MEM_FREE(output_path);
+}
+
+/* compile every input to its own output file on opt->jobs threads */
+static int compile_batch(const option_t *opt) {
+  batch_t batch;
+  int error_count = 0;
+
+  if (opt->dump_tree || opt->run || opt->jit) {
+    fprintf(stderr, "error: -d, -r and -x take a single input file.\n");
+    return 1;
+  }
+
+  batch.opt = opt;
+  batch.error_counts = (int *)AK_MEM_CALLOC(opt->input_count, sizeof(int));
+  batch.messages = (sink_t **)AK_MEM_CALLOC(opt->input_count, sizeof(sink_t *));
+
+  pool_run(opt->jobs, opt->input_count, compile_task, &batch);
+
+  for (int i = 0; i < opt->input_count; ++i) {
+    print_messages(opt->input_paths[i], batch.messages[i]);
+    sink_release(&batch.messages[i]);
+    error_count += batch.error_counts[i];
+  }
+  AK_MEM_FREE(batch.messages);
+  AK_MEM_FREE(batch.error_counts);
+
+  return error_count;
+}
+
+int main(int argc, char *argv[]) {
+  option_t opt = { .input_paths = NULL, .input_count = 0, .output_dir = NULL, .jobs = 0, .dump_tree = false, .run = false, .jit = false, .verbose = false, .optimize = 0, .emit_mode = EMIT_WHITESPACE };
+  int error_count = 0;
+
+  symbol_acquire();
+
+  /* process command line args */
+  opt.input_paths = (const char **)AK_MEM_MALLOC(sizeof(const char *) * argc);
+  process_options(argc, argv, &opt);
+
+  if (opt.input_count > 1 || opt.output_dir) {
+    error_count = compile_batch(&opt);
+  }
+  else {
+    sink_t *messages = sink_new_file(stderr);
+    error_count = compile(&opt, opt.input_count > 0 ? opt.input_paths[0] : NULL, NULL, messages);
+    sink_release(&messages);
   }
 
-  node_release(&node);
+  AK_MEM_FREE((void *)opt.input_paths);
+  symbol_release();
 
   AK_MEM_CHECK;
   return error_count == 0 ? 0 : 1;
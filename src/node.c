@@ -1,238 +1,255 @@
 #include <stdbool.h>
 #include <stdio.h>
-#include <string.h>
 #include "node.h"
-#include "utils/memory.h"
+#include "utils/arena.h"
 #include "utils/array.h"
+#include "utils/symbol.h"
 
-#define VARIABLE_NAME_MAX         ( 63 )
-#define INITIAL_CHILDREN_CAPACITY ( 4 )
+#define INITIAL_CHILDREN_CAPACITY ( 2 )
 
+/* which member of 'u' is valid depends on ntype */
 struct node_t {
   ntype_t      ntype;
-  unary_op_t   uop;
-  binary_op_t  bop;
-  int          value;
-  char         name[VARIABLE_NAME_MAX + 1];
-  array_t     *children;
+  union {
+    unary_op_t  uop;
+    binary_op_t bop;
+    int         value;
+    symbol_t    symbol;
+  } u;
+  int          child_count;
+  int          child_capacity;
+  node_t     **children;
 };
 
-node_t *node_new(ntype_t ntype) {
-  node_t *node = (node_t *)AK_MEM_MALLOC(sizeof(node_t));
-  node->ntype    = ntype;
-  node->uop      = UOP_INVALID;
-  node->bop      = BOP_INVALID;
-  node->value    = 0;
-  node->children = array_new(INITIAL_CHILDREN_CAPACITY);
+/*
+ * Nodes and their child slices are allocated from the arena and are freed
+ * all at once when the arena is released.
+ */
+node_t *node_new(arena_t *arena, ntype_t ntype) {
+  node_t *node = (node_t *)arena_alloc(arena, sizeof(node_t));
+  node->ntype          = ntype;
+  node->u.value        = 0;
+  node->child_count    = 0;
+  node->child_capacity = 0;
+  node->children       = NULL;
   return node;
 }
 
-void node_release(node_t **pnode) {
-  node_t *node = *pnode;
-
-  for (int i = 0; i < node_get_child_count(node); ++i) {
-    node_t *child = node_get_child(node, i);
-    node_release(&child);
-  }
-  array_release(&node->children);
-
-  AK_MEM_FREE(node);
-  *pnode = NULL;
+node_t *node_new_invalid(arena_t *arena) {
+  return node_new(arena, NT_INVALID);
 }
 
-node_t *node_new_invalid(void) {
-  return node_new(NT_INVALID);
-}
-
-node_t *node_new_group(node_t *child, const char *group_label) {
-  node_t *node = node_new(NT_GROUP);
-  node_add_child(node, child);
-  strncpy(node->name, group_label, VARIABLE_NAME_MAX);
+node_t *node_new_group(arena_t *arena, node_t *child, const char *group_label) {
+  node_t *node = node_new(arena, NT_GROUP);
+  node_add_child(arena, node, child);
+  node->u.symbol = symbol_intern(group_label);
   return node;
 }
 
-node_t *node_new_empty(void) {
-  return node_new(NT_EMPTY);
+node_t *node_new_empty(arena_t *arena) {
+  return node_new(arena, NT_EMPTY);
 }
 
-node_t *node_new_seq(void) {
-  return node_new(NT_SEQ);
+node_t *node_new_seq(arena_t *arena) {
+  return node_new(arena, NT_SEQ);
 }
 
-node_t *node_new_expr(node_t *expr) {
-  node_t *node = node_new(NT_EXPR);
-  node_add_child(node, expr);
+node_t *node_new_expr(arena_t *arena, node_t *expr) {
+  node_t *node = node_new(arena, NT_EXPR);
+  node_add_child(arena, node, expr);
   return node;
 }
 
-node_t *node_new_unary(unary_op_t uop, node_t *arg) {
-  node_t *node = node_new(NT_UNARY);
-  node->uop = uop;
-  node_add_child(node, arg);
+node_t *node_new_unary(arena_t *arena, unary_op_t uop, node_t *arg) {
+  node_t *node = node_new(arena, NT_UNARY);
+  node->u.uop = uop;
+  node_add_child(arena, node, arg);
   return node;
 }
 
-node_t *node_new_binary(binary_op_t bop, node_t *lhs, node_t *rhs) {
-  node_t *node = node_new(NT_BINARY);
-  node->bop = bop;
-  node_add_child(node, lhs);
-  node_add_child(node, rhs);
+node_t *node_new_binary(arena_t *arena, binary_op_t bop, node_t *lhs, node_t *rhs) {
+  node_t *node = node_new(arena, NT_BINARY);
+  node->u.bop = bop;
+  node_add_child(arena, node, lhs);
+  node_add_child(arena, node, rhs);
   return node;
 }
 
-node_t *node_new_assign(node_t *lhs, node_t *rhs) {
-  node_t *node = node_new(NT_ASSIGN);
-  node_add_child(node, lhs);
-  node_add_child(node, rhs);
+node_t *node_new_assign(arena_t *arena, node_t *lhs, node_t *rhs) {
+  node_t *node = node_new(arena, NT_ASSIGN);
+  node_add_child(arena, node, lhs);
+  node_add_child(arena, node, rhs);
   return node;
 }
 
-node_t *node_new_integer(int value) {
-  node_t *node = node_new(NT_INTEGER);
-  node->value = value;
+node_t *node_new_integer(arena_t *arena, int value) {
+  node_t *node = node_new(arena, NT_INTEGER);
+  node->u.value = value;
   return node;
 }
 
-node_t *node_new_ident(const char *name) {
-  node_t *node = node_new(NT_IDENT);
-  strncpy(node->name, name, VARIABLE_NAME_MAX);
+node_t *node_new_ident(arena_t *arena, symbol_t name) {
+  node_t *node = node_new(arena, NT_IDENT);
+  node->u.symbol = name;
   return node;
 }
 
-node_t *node_new_variable(node_t *ident) {
-  node_t *node = node_new(NT_VARIABLE);
-  node_add_child(node, ident);
+node_t *node_new_variable(arena_t *arena, node_t *ident) {
+  node_t *node = node_new(arena, NT_VARIABLE);
+  node_add_child(arena, node, ident);
   return node;
 }
 
-node_t *node_new_array(node_t *ident, node_t *indexer) {
-  node_t *node = node_new(NT_ARRAY);
-  node_add_child(node, ident);
-  node_add_child(node, indexer);
+node_t *node_new_array(arena_t *arena, node_t *ident, node_t *indexer) {
+  node_t *node = node_new(arena, NT_ARRAY);
+  node_add_child(arena, node, ident);
+  node_add_child(arena, node, indexer);
   return node;
 }
 
-node_t *node_new_func_call(node_t *ident, node_t *arg) {
-  node_t *node = node_new(NT_FUNC_CALL);
-  node_add_child(node, ident);
-  node_add_child(node, arg);
+node_t *node_new_func_call(arena_t *arena, node_t *ident, node_t *arg) {
+  node_t *node = node_new(arena, NT_FUNC_CALL);
+  node_add_child(arena, node, ident);
+  node_add_child(arena, node, arg);
   return node;
 }
 
-node_t *node_new_func_call_arg(void) {
-  return node_new(NT_FUNC_CALL_ARG);
+node_t *node_new_func_call_arg(arena_t *arena) {
+  return node_new(arena, NT_FUNC_CALL_ARG);
 }
 
-node_t *node_new_if(node_t *cond, node_t *then, node_t *els) {
-  node_t *node = node_new(NT_IF);
-  node_add_child(node, cond);
-  node_add_child(node, then);
+node_t *node_new_if(arena_t *arena, node_t *cond, node_t *then, node_t *els) {
+  node_t *node = node_new(arena, NT_IF);
+  node_add_child(arena, node, cond);
+  node_add_child(arena, node, then);
   if (els) {
-    node_add_child(node, els);
+    node_add_child(arena, node, els);
   }
   return node;
 }
 
-node_t *node_new_while(node_t *cond, node_t *body) {
-  node_t *node = node_new(NT_WHILE);
-  node_add_child(node, cond);
-  node_add_child(node, body);
+node_t *node_new_while(arena_t *arena, node_t *cond, node_t *body) {
+  node_t *node = node_new(arena, NT_WHILE);
+  node_add_child(arena, node, cond);
+  node_add_child(arena, node, body);
   return node;
 }
 
-node_t *node_new_loop_statement(node_t *body) {
-  node_t *node = node_new(NT_LOOP_STATEMENT);
-  node_add_child(node, body);
+node_t *node_new_loop_statement(arena_t *arena, node_t *body) {
+  node_t *node = node_new(arena, NT_LOOP_STATEMENT);
+  node_add_child(arena, node, body);
   return node;
 }
 
-node_t *node_new_for_statement(node_t *init, node_t *cond, node_t *next, node_t *body) {
-  node_t *node = node_new(NT_FOR_STATEMENT);
-  node_add_child(node, init);
-  node_add_child(node, cond);
-  node_add_child(node, next);
-  node_add_child(node, body);
+node_t *node_new_for_statement(arena_t *arena, node_t *init, node_t *cond, node_t *next, node_t *body) {
+  node_t *node = node_new(arena, NT_FOR_STATEMENT);
+  node_add_child(arena, node, init);
+  node_add_child(arena, node, cond);
+  node_add_child(arena, node, next);
+  node_add_child(arena, node, body);
   return node;
 }
 
-node_t *node_new_break(void) {
-  return node_new(NT_BREAK);
+node_t *node_new_break(arena_t *arena) {
+  return node_new(arena, NT_BREAK);
 }
 
-node_t *node_new_continue(void) {
-  return node_new(NT_CONTINUE);
+node_t *node_new_continue(arena_t *arena) {
+  return node_new(arena, NT_CONTINUE);
 }
 
-node_t *node_new_puti(node_t *expr) {
-  node_t *node = node_new(NT_PUTI);
-  node_add_child(node, expr);
+node_t *node_new_puti(arena_t *arena, node_t *expr) {
+  node_t *node = node_new(arena, NT_PUTI);
+  node_add_child(arena, node, expr);
   return node;
 }
 
-node_t *node_new_putc(node_t *expr) {
-  node_t *node = node_new(NT_PUTC);
-  node_add_child(node, expr);
+node_t *node_new_putc(arena_t *arena, node_t *expr) {
+  node_t *node = node_new(arena, NT_PUTC);
+  node_add_child(arena, node, expr);
   return node;
 }
 
-node_t *node_new_geti(node_t *var) {
-  node_t *node = node_new(NT_GETI);
-  node_add_child(node, var);
+node_t *node_new_geti(arena_t *arena, node_t *var) {
+  node_t *node = node_new(arena, NT_GETI);
+  node_add_child(arena, node, var);
   return node;
 }
 
-node_t *node_new_getc(node_t *var) {
-  node_t *node = node_new(NT_GETC);
-  node_add_child(node, var);
+node_t *node_new_getc(arena_t *arena, node_t *var) {
+  node_t *node = node_new(arena, NT_GETC);
+  node_add_child(arena, node, var);
   return node;
 }
 
-node_t *node_new_array_decl(node_t *ident, node_t *capacity) {
-  node_t *node = node_new(NT_ARRAY_DECL);
-  node_add_child(node, ident);
-  node_add_child(node, capacity);
+node_t *node_new_array_decl(arena_t *arena, node_t *ident, node_t *capacity) {
+  node_t *node = node_new(arena, NT_ARRAY_DECL);
+  node_add_child(arena, node, ident);
+  node_add_child(arena, node, capacity);
   return node;
 }
 
-node_t *node_new_return(node_t *expr) {
-  node_t *node = node_new(NT_RETURN);
-  node_add_child(node, expr);
+node_t *node_new_return(arena_t *arena, node_t *expr) {
+  node_t *node = node_new(arena, NT_RETURN);
+  node_add_child(arena, node, expr);
   return node;
 }
 
-node_t *node_new_halt(void) {
-  return node_new(NT_HALT);
+node_t *node_new_halt(arena_t *arena) {
+  return node_new(arena, NT_HALT);
 }
 
-node_t *node_new_func(node_t *ident, node_t *param, node_t *body) {
-  node_t *node = node_new(NT_FUNC);
-  node_add_child(node, ident);
-  node_add_child(node, param);
-  node_add_child(node, body);
+node_t *node_new_func(arena_t *arena, node_t *ident, node_t *param, node_t *body) {
+  node_t *node = node_new(arena, NT_FUNC);
+  node_add_child(arena, node, ident);
+  node_add_child(arena, node, param);
+  node_add_child(arena, node, body);
   return node;
 }
 
-node_t *node_new_func_param(void) {
-  return node_new(NT_FUNC_PARAM);
+node_t *node_new_func_param(arena_t *arena) {
+  return node_new(arena, NT_FUNC_PARAM);
 }
 
-node_t *node_new_const_statement(node_t *ident, node_t *value) {
-  node_t *node = node_new(NT_CONST_STATEMENT);
-  node_add_child(node, ident);
-  node_add_child(node, value);
+node_t *node_new_const_statement(arena_t *arena, node_t *ident, node_t *value) {
+  node_t *node = node_new(arena, NT_CONST_STATEMENT);
+  node_add_child(arena, node, ident);
+  node_add_child(arena, node, value);
   return node;
 }
 
-void node_add_child(node_t *node, node_t *child) {
-  array_append(node->children, child);
+void node_add_child(arena_t *arena, node_t *node, node_t *child) {
+  if (node->child_count == node->child_capacity) {
+    int capacity = node->child_capacity > 0 ? node->child_capacity * 2 : INITIAL_CHILDREN_CAPACITY;
+    node_t **children = (node_t **)arena_alloc(arena, sizeof(node_t *) * capacity);
+
+    /* the old slice stays in the arena until it is released */
+    for (int i = 0; i < node->child_count; ++i) {
+      children[i] = node->children[i];
+    }
+    node->children = children;
+    node->child_capacity = capacity;
+  }
+  node->children[node->child_count++] = child;
+}
+
+void node_set_child(node_t *node, int i, node_t *child) {
+  node->children[i] = child;
+}
+
+/* turn the node into an integer literal, dropping its children */
+void node_set_integer(node_t *node, int value) {
+  node->ntype = NT_INTEGER;
+  node->u.value = value;
+  node->child_count = 0;
 }
 
 node_t *node_get_child(node_t *node, int i) {
-  return (node_t *)array_get(node->children, i);
+  return node->children[i];
 }
 
 int node_get_child_count(node_t *node) {
-  return array_count(node->children);
+  return node->child_count;
 }
 
 ntype_t node_get_ntype(node_t *node) {
@@ -240,19 +257,24 @@ ntype_t node_get_ntype(node_t *node) {
 }
 
 unary_op_t node_get_uop(node_t *node) {
-  return node->uop;
+  return node->ntype == NT_UNARY ? node->u.uop : UOP_INVALID;
 }
 
 binary_op_t node_get_bop(node_t *node) {
-  return node->bop;
+  return node->ntype == NT_BINARY ? node->u.bop : BOP_INVALID;
 }
 
 int node_get_value(node_t *node) {
-  return node->value;
+  return node->ntype == NT_INTEGER ? node->u.value : 0;
+}
+
+symbol_t node_get_symbol(node_t *node) {
+  return node->ntype == NT_IDENT || node->ntype == NT_GROUP ? node->u.symbol : SYMBOL_NONE;
 }
 
 const char *node_get_name(node_t *node) {
-  return node->name;
+  symbol_t symbol = node_get_symbol(node);
+  return symbol != SYMBOL_NONE ? symbol_get_name(symbol) : "";
 }
 
 int node_is_assignable(node_t *node) {
@@ -282,3 +304,36 @@ bool node_is_all_paths_ended_with_return(node_t *node) {
     return false;
   }
 }
+
+bool node_has_side_effects(node_t *node) {
+  switch (node->ntype) {
+  case NT_ASSIGN:
+  case NT_FUNC_CALL:
+    return true;
+  default:
+    break;
+  }
+
+  for (int i = 0; i < node_get_child_count(node); ++i) {
+    if (node_has_side_effects(node_get_child(node, i))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* appends the top-level const statements in source order */
+void node_collect_const_defs(node_t *node, array_t *defs) {
+  switch (node->ntype) {
+  case NT_SEQ:
+    for (int i = 0; i < node_get_child_count(node); ++i) {
+      node_collect_const_defs(node_get_child(node, i), defs);
+    }
+    break;
+  case NT_CONST_STATEMENT:
+    array_append(defs, node);
+    break;
+  default:
+    break;
+  }
+}
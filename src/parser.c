@@ -1,15 +1,34 @@
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "parser.h"
-#include "lexer.h"
+#include "tokens.h"
 #include "operator.h"
 #include "node.h"
 #include "utils/memory.h"
+#include "utils/arena.h"
+#include "utils/symbol.h"
+#include "utils/sink.h"
 
+#define ARENA_CHUNK_SIZE ( 64 * 1024 )
+
+/* the parser walks the token stream by index, pos is the current token */
 struct parser_t {
-  lexer_t *lexer;
-  int      error_count;
+  tokens_t *tokens;
+  int       pos;
+  arena_t  *arena;
+  int       error_count;
+  sink_t   *messages;
 };
 
+static ttype_t     current_ttype(parser_t *parser);
+static location_t  current_location(parser_t *parser);
+static const char *current_text(parser_t *parser);
+static int         current_text_length(parser_t *parser);
+static int         current_int_value(parser_t *parser);
+static void        advance(parser_t *parser);
+static void        report(parser_t *parser, const char *fmt, ...);
+
 static int     is_eof(parser_t *parser);
 static int     is_ttype(parser_t *parser, ttype_t ttype);
 static node_t *parse_program(parser_t *parser);
@@ -45,26 +64,70 @@ static node_t *parse_func_call_arg(parser_t *parser);
 static node_t *parse_ident(parser_t *parser);
 static node_t *parse_integer(parser_t *parser);
 
-parser_t *parser_new(FILE *input) {
+/* the source must outlive the parser, the syntax tree does not refer to it */
+parser_t *parser_new(const char *src, size_t length) {
   parser_t *parser = (parser_t *)AK_MEM_MALLOC(sizeof(parser_t));
-  parser->lexer = lexer_new(input);
+  parser->tokens = tokens_new(src, length);
+  parser->pos = 0;
+  parser->arena = arena_new(ARENA_CHUNK_SIZE);
   parser->error_count = 0;
+  parser->messages = NULL;
   return parser;
 }
 
+/* releases the syntax tree as well */
 void parser_release(parser_t **pparser) {
-  lexer_release(&(*pparser)->lexer);
+  tokens_release(&(*pparser)->tokens);
+  arena_release(&(*pparser)->arena);
   AK_MEM_FREE(*pparser);
   *pparser = NULL;
 }
 
 node_t *parser_parse(parser_t *parser) {
-  lexer_next(parser->lexer);
-  return parse_program(parser);
+  node_t *node;
+
+  tokens_report_errors(parser->tokens, parser->pos, parser->messages);
+  node = parse_program(parser);
+  tokens_report_errors(parser->tokens, tokens_count(parser->tokens) - 1, parser->messages);
+
+  return node;
 }
 
 int parser_get_total_error_count(parser_t *parser) {
-  return lexer_get_error_count(parser->lexer) + parser->error_count;
+  return tokens_get_error_count(parser->tokens) + parser->error_count;
+}
+
+/* diagnostics go to the sink instead of standard error; it is not owned */
+void parser_set_messages(parser_t *parser, sink_t *messages) {
+  parser->messages = messages;
+}
+
+static ttype_t current_ttype(parser_t *parser) {
+  return tokens_ttype(parser->tokens, parser->pos);
+}
+
+static location_t current_location(parser_t *parser) {
+  return tokens_location(parser->tokens, parser->pos);
+}
+
+static const char *current_text(parser_t *parser) {
+  return tokens_text(parser->tokens, parser->pos);
+}
+
+static int current_text_length(parser_t *parser) {
+  return tokens_text_length(parser->tokens, parser->pos);
+}
+
+static int current_int_value(parser_t *parser) {
+  return tokens_int_value(parser->tokens, parser->pos);
+}
+
+/* the stream ends with an EOF token, which is never passed */
+static void advance(parser_t *parser) {
+  if (parser->pos < tokens_count(parser->tokens) - 1) {
+    ++parser->pos;
+    tokens_report_errors(parser->tokens, parser->pos, parser->messages);
+  }
 }
 
 static int is_eof(parser_t *parser) {
@@ -72,21 +135,22 @@ static int is_eof(parser_t *parser) {
 }
 
 static int is_ttype(parser_t *parser, ttype_t ttype) {
-  return lexer_ttype(parser->lexer) == ttype;
+  return current_ttype(parser) == ttype;
 }
 
 static int expect(parser_t *parser, ttype_t ttype) {
   location_t location;
 
   if (is_ttype(parser, ttype)) {
-    lexer_next(parser->lexer);
+    advance(parser);
     return 1;
   }
 
-  location = lexer_get_location(parser->lexer);
-  fprintf(stderr, "error: unexpected '%s' (%s), but expected %s. (line:%d,column:%d)\n",
-	  lexer_text(parser->lexer),
-          ttype_to_string(lexer_ttype(parser->lexer)),
+  location = current_location(parser);
+  report(parser, "error: unexpected '%.*s' (%s), but expected %s. (line:%d,column:%d)\n",
+	  current_text_length(parser),
+	  current_text(parser),
+          ttype_to_string(current_ttype(parser)),
           ttype_to_string(ttype),
           location.line,
           location.column);
@@ -95,18 +159,18 @@ static int expect(parser_t *parser, ttype_t ttype) {
 }
 
 static node_t *parse_program(parser_t *parser) {
-  node_t *seq = node_new_seq();
+  node_t *seq = node_new_seq(parser->arena);
   while (!is_eof(parser)) {
-    node_add_child(seq, parse_toplevel_statement(parser));
+    node_add_child(parser->arena, seq, parse_toplevel_statement(parser));
   }
   return seq;
 }
 
 static node_t *parse_block(parser_t *parser) {
-  node_t *seq = node_new_seq();
+  node_t *seq = node_new_seq(parser->arena);
   expect(parser, TT_LBRACE);
   while (!is_eof(parser) && !is_ttype(parser, TT_RBRACE)) {
-    node_add_child(seq, parse_statement(parser));
+    node_add_child(parser->arena, seq, parse_statement(parser));
   }
   expect(parser, TT_RBRACE);
   return seq;
@@ -115,7 +179,7 @@ static node_t *parse_block(parser_t *parser) {
 static node_t *parse_toplevel_statement(parser_t *parser) {
   location_t location;
 
-  switch (lexer_ttype(parser->lexer)) {
+  switch (current_ttype(parser)) {
   case TT_KW_ARRAY:
     return parse_array_statement(parser);
   case TT_KW_FUNC:
@@ -126,19 +190,20 @@ static node_t *parse_toplevel_statement(parser_t *parser) {
     break;
   }
 
-  location = lexer_get_location(parser->lexer);
-  fprintf(stderr, "error: unexpected '%s' (%s). Only 'array', 'func' or 'const' are allowed as toplevel statement. (line:%d,column:%d)\n",
-	  lexer_text(parser->lexer),
-          ttype_to_string(lexer_ttype(parser->lexer)),
+  location = current_location(parser);
+  report(parser, "error: unexpected '%.*s' (%s). Only 'array', 'func' or 'const' are allowed as toplevel statement. (line:%d,column:%d)\n",
+	  current_text_length(parser),
+	  current_text(parser),
+          ttype_to_string(current_ttype(parser)),
           location.line,
           location.column);
   ++parser->error_count;
-  lexer_next(parser->lexer);
-  return node_new_invalid();
+  advance(parser);
+  return node_new_invalid(parser->arena);
 }
 
 static node_t *parse_statement(parser_t *parser) {
-  switch (lexer_ttype(parser->lexer)) {
+  switch (current_ttype(parser)) {
   case TT_LBRACE:
     return parse_block(parser);
   case TT_KW_IF:
@@ -175,16 +240,16 @@ static node_t *parse_if_statement(parser_t *parser) {
 
   expect(parser, TT_KW_IF);
   expect(parser, TT_LPAREN);
-  cond = node_new_group(parse_expr(parser), "Condition");
+  cond = node_new_group(parser->arena, parse_expr(parser), "Condition");
   expect(parser, TT_RPAREN);
-  then = node_new_group(parse_statement(parser), "Then-Clause");
+  then = node_new_group(parser->arena, parse_statement(parser), "Then-Clause");
 
   if (is_ttype(parser, TT_KW_ELSE)) {
-    lexer_next(parser->lexer);
-    els = node_new_group(parse_statement(parser), "Else-Clause");
+    advance(parser);
+    els = node_new_group(parser->arena, parse_statement(parser), "Else-Clause");
   }
 
-  return node_new_if(cond, then, els);
+  return node_new_if(parser->arena, cond, then, els);
 }
 
 static node_t *parse_while_statement(parser_t *parser) {
@@ -192,18 +257,18 @@ static node_t *parse_while_statement(parser_t *parser) {
 
   expect(parser, TT_KW_WHILE);
   expect(parser, TT_LPAREN);
-  cond = node_new_group(parse_expr(parser), "Condition");
+  cond = node_new_group(parser->arena, parse_expr(parser), "Condition");
   expect(parser, TT_RPAREN);
-  body = node_new_group(parse_statement(parser), "Body-Clause");
+  body = node_new_group(parser->arena, parse_statement(parser), "Body-Clause");
 
-  return node_new_while(cond, body);
+  return node_new_while(parser->arena, cond, body);
 }
 
 static node_t *parse_loop_statement(parser_t *parser) {
   node_t *body = NULL;
   expect(parser, TT_KW_LOOP);
   body = parse_statement(parser);
-  return node_new_loop_statement(body);
+  return node_new_loop_statement(parser->arena, body);
 }
 
 static node_t *parse_for_statement(parser_t *parser) {
@@ -211,46 +276,46 @@ static node_t *parse_for_statement(parser_t *parser) {
   expect(parser, TT_KW_FOR);
   expect(parser, TT_LPAREN);
   if (!is_ttype(parser, TT_SEMICOLON)) {
-    init = node_new_group(parse_expr(parser), "Init-Clause");
+    init = node_new_group(parser->arena, parse_expr(parser), "Init-Clause");
   }
   else {
-    init = node_new_empty();
+    init = node_new_empty(parser->arena);
   }
   expect(parser, TT_SEMICOLON);
   if (!is_ttype(parser, TT_SEMICOLON)) {
-    cond = node_new_group(parse_expr(parser), "Condition-Clause");
+    cond = node_new_group(parser->arena, parse_expr(parser), "Condition-Clause");
   }
   else {
-    cond = node_new_empty();
+    cond = node_new_empty(parser->arena);
   }
   expect(parser, TT_SEMICOLON);
   if (!is_ttype(parser, TT_RPAREN)) {
-    next = node_new_group(parse_expr(parser), "Next-Clause");
+    next = node_new_group(parser->arena, parse_expr(parser), "Next-Clause");
   }
   else {
-    next = node_new_empty();
+    next = node_new_empty(parser->arena);
   }
   expect(parser, TT_RPAREN);
-  body = node_new_group(parse_statement(parser), "Body-Clause");
-  return node_new_for_statement(init, cond, next, body);
+  body = node_new_group(parser->arena, parse_statement(parser), "Body-Clause");
+  return node_new_for_statement(parser->arena, init, cond, next, body);
 }
 
 static node_t *parse_break_statement(parser_t *parser) {
   expect(parser, TT_KW_BREAK);
   expect(parser, TT_SEMICOLON);
-  return node_new_break();
+  return node_new_break(parser->arena);
 }
 
 static node_t *parse_continue_statement(parser_t *parser) {
   expect(parser, TT_KW_CONTINUE);
   expect(parser, TT_SEMICOLON);
-  return node_new_continue();
+  return node_new_continue(parser->arena);
 }
 
 static node_t *parse_puti(parser_t *parser) {
   node_t *node;
   expect(parser, TT_KW_PUTI);
-  node = node_new_puti(parse_expr(parser));
+  node = node_new_puti(parser->arena, parse_expr(parser));
   expect(parser, TT_SEMICOLON);
   return node;
 }
@@ -258,7 +323,7 @@ static node_t *parse_puti(parser_t *parser) {
 static node_t *parse_putc(parser_t *parser) {
   node_t *node;
   expect(parser, TT_KW_PUTC);
-  node = node_new_putc(parse_expr(parser));
+  node = node_new_putc(parser->arena, parse_expr(parser));
   expect(parser, TT_SEMICOLON);
   return node;
 }
@@ -269,7 +334,7 @@ static node_t *parse_putc(parser_t *parser) {
 static node_t *parse_geti(parser_t *parser) {
   node_t *node;
   expect(parser, TT_KW_GETI);
-  node = node_new_geti(parse_ident(parser));
+  node = node_new_geti(parser->arena, parse_ident(parser));
   expect(parser, TT_SEMICOLON);
   return node;
 }
@@ -280,7 +345,7 @@ static node_t *parse_geti(parser_t *parser) {
 static node_t *parse_getc(parser_t *parser) {
   node_t *node;
   expect(parser, TT_KW_GETC);
-  node = node_new_getc(parse_ident(parser));
+  node = node_new_getc(parser->arena, parse_ident(parser));
   expect(parser, TT_SEMICOLON);
   return node;
 }
@@ -298,7 +363,7 @@ static node_t *parse_array_statement(parser_t *parser) {
   expect(parser, TT_RBRACKET);
   expect(parser, TT_SEMICOLON);
 
-  return node_new_array_decl(ident, capacity);
+  return node_new_array_decl(parser->arena, ident, capacity);
 }
 
 /*
@@ -309,27 +374,27 @@ static node_t *parse_return_statement(parser_t *parser) {
   expect(parser, TT_KW_RETURN);
   expr = parse_expr(parser);
   expect(parser, TT_SEMICOLON);
-  return node_new_return(expr);
+  return node_new_return(parser->arena, expr);
 }
 
 static node_t *parse_halt_statement(parser_t *parser) {
   expect(parser, TT_KW_HALT);
   expect(parser, TT_SEMICOLON);
-  return node_new_halt();
+  return node_new_halt(parser->arena);
 }
 
 /*
  * <<FuncParam>> ::= [ <Ident> { ',' <Ident> } ]
  */
 static node_t *parse_func_param(parser_t *parser) {
-  node_t *param = node_new_func_param();
+  node_t *param = node_new_func_param(parser->arena);
 
   if (is_ttype(parser, TT_SYMBOL)) {
-    node_add_child(param, parse_ident(parser));
+    node_add_child(parser->arena, param, parse_ident(parser));
 
     while (is_ttype(parser, TT_COMMA)) {
       expect(parser, TT_COMMA);
-      node_add_child(param, parse_ident(parser));
+      node_add_child(parser->arena, param, parse_ident(parser));
     }
   }
   return param;
@@ -349,11 +414,11 @@ static node_t *parse_func_statement(parser_t *parser) {
   body = parse_block(parser);
 
   if (!node_is_all_paths_ended_with_return(body)) {
-    fprintf(stderr, "error: function '%s' has code path(s) not returning a value.\n", node_get_name(ident));
+    report(parser, "error: function '%s' has code path(s) not returning a value.\n", node_get_name(ident));
     ++parser->error_count;
   }
 
-  return node_new_func(ident, param, body);
+  return node_new_func(parser->arena, ident, param, body);
 }
 
 /*
@@ -368,13 +433,13 @@ static node_t *parse_const_statement(parser_t *parser) {
   value = parse_integer(parser);
   expect(parser, TT_SEMICOLON);
 
-  return node_new_const_statement(ident, value);
+  return node_new_const_statement(parser->arena, ident, value);
 }
 
 static node_t *parse_expr_statement(parser_t *parser) {
   node_t *expr = parse_expr(parser);
   expect(parser, TT_SEMICOLON);
-  return node_new_expr(expr);
+  return node_new_expr(parser->arena, expr);
 }
 
 static node_t *parse_expr(parser_t *parser) {
@@ -383,19 +448,19 @@ static node_t *parse_expr(parser_t *parser) {
 
 static node_t *parse_assign(parser_t *parser) {
   node_t *x, *y;
-  location_t location = lexer_get_location(parser->lexer);
+  location_t location = current_location(parser);
 
   x = parse_or(parser);
   if (is_ttype(parser, TT_EQ)) {
-    lexer_next(parser->lexer);
+    advance(parser);
 
     if (!node_is_assignable(x)) {
-      fprintf(stderr, "error: left hand side of assignment should be variable or array. (line:%d,column:%d)\n", location.line, location.column);
+      report(parser, "error: left hand side of assignment should be variable or array. (line:%d,column:%d)\n", location.line, location.column);
       ++parser->error_count;
     }
 
     y = parse_assign(parser);
-    x = node_new_assign(x, y);
+    x = node_new_assign(parser->arena, x, y);
   }
   return x;
 }
@@ -404,9 +469,9 @@ static node_t *parse_or(parser_t *parser) {
   node_t *x, *y;
   x = parse_and(parser);
   while (is_ttype(parser, TT_BAR)) {
-    lexer_next(parser->lexer);
+    advance(parser);
     y = parse_and(parser);
-    x = node_new_binary(BOP_OR, x, y);
+    x = node_new_binary(parser->arena, BOP_OR, x, y);
   }
   return x;
 }
@@ -415,9 +480,9 @@ static node_t *parse_and(parser_t *parser) {
   node_t *x, *y;
   x = parse_comparison(parser);
   while (is_ttype(parser, TT_AMP)) {
-    lexer_next(parser->lexer);
+    advance(parser);
     y = parse_comparison(parser);
-    x = node_new_binary(BOP_AND, x, y);
+    x = node_new_binary(parser->arena, BOP_AND, x, y);
   }
   return x;
 }
@@ -431,10 +496,10 @@ static node_t *parse_comparison(parser_t *parser) {
          is_ttype(parser, TT_LE) ||
          is_ttype(parser, TT_GT) ||
          is_ttype(parser, TT_GE)) {
-    binary_op_t bop = ttype_to_binary_op(lexer_ttype(parser->lexer));
-    lexer_next(parser->lexer);
+    binary_op_t bop = ttype_to_binary_op(current_ttype(parser));
+    advance(parser);
     y = parse_addsub(parser);
-    x = node_new_binary(bop, x, y);
+    x = node_new_binary(parser->arena, bop, x, y);
   }
   return x;
 }
@@ -443,10 +508,10 @@ static node_t *parse_addsub(parser_t *parser) {
   node_t *x, *y;
   x = parse_muldiv(parser);
   while (is_ttype(parser, TT_PLUS) || is_ttype(parser, TT_MINUS)) {
-    binary_op_t bop = ttype_to_binary_op(lexer_ttype(parser->lexer));
-    lexer_next(parser->lexer);
+    binary_op_t bop = ttype_to_binary_op(current_ttype(parser));
+    advance(parser);
     y = parse_muldiv(parser);
-    x = node_new_binary(bop, x, y);
+    x = node_new_binary(parser->arena, bop, x, y);
   }
   return x;
 }
@@ -455,10 +520,10 @@ static node_t *parse_muldiv(parser_t *parser) {
   node_t *x, *y;
   x = parse_atomic(parser);
   while (is_ttype(parser, TT_ASTERISK) || is_ttype(parser, TT_SLASH) || is_ttype(parser, TT_PERCENT)) {
-    binary_op_t bop = ttype_to_binary_op(lexer_ttype(parser->lexer));
-    lexer_next(parser->lexer);
+    binary_op_t bop = ttype_to_binary_op(current_ttype(parser));
+    advance(parser);
     y = parse_atomic(parser);
-    x = node_new_binary(bop, x, y);
+    x = node_new_binary(parser->arena, bop, x, y);
   }
   return x;
 }
@@ -467,32 +532,32 @@ static node_t *parse_atomic(parser_t *parser) {
   node_t *node = NULL;
   location_t location;
 
-  switch (lexer_ttype(parser->lexer)) {
+  switch (current_ttype(parser)) {
   case TT_INTEGER:
   case TT_CHAR:
     return parse_integer(parser);
   case TT_PLUS:
     /* simply ignore */
-    lexer_next(parser->lexer);
+    advance(parser);
     return parse_atomic(parser);
   case TT_MINUS:
-    lexer_next(parser->lexer);
+    advance(parser);
     node = parse_atomic(parser);
-    return node_new_unary(UOP_NEGATIVE, node);
+    return node_new_unary(parser->arena, UOP_NEGATIVE, node);
   case TT_EXCLA:
-    lexer_next(parser->lexer);
+    advance(parser);
     node = parse_atomic(parser);
-    return node_new_unary(UOP_NOT, node);
+    return node_new_unary(parser->arena, UOP_NOT, node);
   case TT_SYMBOL:
     node = parse_ident(parser);
     if (is_ttype(parser, TT_LBRACKET)) {
-      node = node_new_array(node, parse_array_indexer(parser));
+      node = node_new_array(parser->arena, node, parse_array_indexer(parser));
     }
     else if (is_ttype(parser, TT_LPAREN)) {
-      node = node_new_func_call(node, parse_func_call_arg(parser));
+      node = node_new_func_call(parser->arena, node, parse_func_call_arg(parser));
     }
     else {
-      node = node_new_variable(node);
+      node = node_new_variable(parser->arena, node);
     }
     return node;
   case TT_LPAREN:
@@ -504,11 +569,11 @@ static node_t *parse_atomic(parser_t *parser) {
     break;
   }
 
-  location = lexer_get_location(parser->lexer);
-  fprintf(stderr, "error: unexpected '%s' (%s). (line:%d,column:%d)\n", lexer_text(parser->lexer), ttype_to_string(lexer_ttype(parser->lexer)), location.line, location.column);
-  lexer_next(parser->lexer);
+  location = current_location(parser);
+  report(parser, "error: unexpected '%.*s' (%s). (line:%d,column:%d)\n", current_text_length(parser), current_text(parser), ttype_to_string(current_ttype(parser)), location.line, location.column);
+  advance(parser);
   ++parser->error_count;
-  return node_new_invalid();
+  return node_new_invalid(parser->arena);
 }
 
 static node_t *parse_array_indexer(parser_t *parser) {
@@ -520,14 +585,14 @@ static node_t *parse_array_indexer(parser_t *parser) {
 }
 
 static node_t *parse_func_call_arg(parser_t *parser) {
-  node_t *node = node_new_func_call_arg();
+  node_t *node = node_new_func_call_arg(parser->arena);
 
   expect(parser, TT_LPAREN);
   if (!is_eof(parser) && !is_ttype(parser, TT_RPAREN)) {
-    node_add_child(node, parse_expr(parser));
+    node_add_child(parser->arena, node, parse_expr(parser));
     while (is_ttype(parser, TT_COMMA)) {
       expect(parser, TT_COMMA);
-      node_add_child(node, parse_expr(parser));
+      node_add_child(parser->arena, node, parse_expr(parser));
     }
   }
   expect(parser, TT_RPAREN);
@@ -536,18 +601,31 @@ static node_t *parse_func_call_arg(parser_t *parser) {
 
 static node_t *parse_ident(parser_t *parser) {
   if (is_ttype(parser, TT_SYMBOL)) {
-    node_t *node = node_new_ident(lexer_text(parser->lexer));
-    lexer_next(parser->lexer);
+    symbol_t name = symbol_intern_n(current_text(parser), current_text_length(parser));
+    node_t *node = node_new_ident(parser->arena, name);
+    advance(parser);
     return node;
   }
-  return node_new_invalid();
+  return node_new_invalid(parser->arena);
 }
 
 static node_t *parse_integer(parser_t *parser) {
   if (is_ttype(parser, TT_INTEGER) || is_ttype(parser, TT_CHAR)) {
-    node_t *node = node_new_integer(lexer_int_value(parser->lexer));
-    lexer_next(parser->lexer);
+    node_t *node = node_new_integer(parser->arena, current_int_value(parser));
+    advance(parser);
     return node;
   }
-  return node_new_invalid();
+  return node_new_invalid(parser->arena);
+}
+
+static void report(parser_t *parser, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (parser->messages) {
+    sink_vprintf(parser->messages, fmt, args);
+  }
+  else {
+    vfprintf(stderr, fmt, args);
+  }
+  va_end(args);
 }
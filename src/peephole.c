@@ -0,0 +1,260 @@
+#include <stdbool.h>
+#include <limits.h>
+#include "peephole.h"
+#include "inst.h"
+
+#define PATTERN_MAX ( 4 )
+
+/*
+ * A rewrite receives the matched window and returns true if it changed it.
+ * Instructions are deleted by turning them into NOPs, which are swept out
+ * before the next round.
+ */
+typedef bool (*rewrite_t)(inst_t *window);
+
+typedef struct {
+  int       length;
+  opcode_t  opcodes[PATTERN_MAX];
+  rewrite_t rewrite;
+} rule_t;
+
+static bool remove_pair(inst_t *window);
+static bool remove_first(inst_t *window);
+static bool remove_identity(inst_t *window);
+static bool fold_constants(inst_t *window);
+static bool fold_additions(inst_t *window);
+static bool copy_to_dup(inst_t *window);
+static bool push_to_dup(inst_t *window);
+static bool slide_zero(inst_t *window);
+static bool jump_to_next(inst_t *window);
+static bool branch_to_next(inst_t *window);
+
+static const rule_t g_rules[] = {
+  { 2, { OP_PUSH, OP_POP                   }, remove_pair     },
+  { 2, { OP_DUP,  OP_POP                   }, remove_pair     },
+  { 2, { OP_COPY, OP_POP                   }, remove_pair     },
+  { 2, { OP_SWAP, OP_SWAP                  }, remove_pair     },
+  { 2, { OP_SWAP, OP_ADD                   }, remove_first    },
+  { 2, { OP_SWAP, OP_MUL                   }, remove_first    },
+  { 2, { OP_PUSH, OP_ADD                   }, remove_identity },
+  { 2, { OP_PUSH, OP_SUB                   }, remove_identity },
+  { 2, { OP_PUSH, OP_MUL                   }, remove_identity },
+  { 2, { OP_PUSH, OP_DIV                   }, remove_identity },
+  { 3, { OP_PUSH, OP_PUSH, OP_ADD          }, fold_constants  },
+  { 3, { OP_PUSH, OP_PUSH, OP_SUB          }, fold_constants  },
+  { 3, { OP_PUSH, OP_PUSH, OP_MUL          }, fold_constants  },
+  { 3, { OP_PUSH, OP_PUSH, OP_DIV          }, fold_constants  },
+  { 3, { OP_PUSH, OP_PUSH, OP_MOD          }, fold_constants  },
+  { 4, { OP_PUSH, OP_ADD,  OP_PUSH, OP_ADD }, fold_additions  },
+  { 1, { OP_COPY                           }, copy_to_dup     },
+  { 2, { OP_PUSH, OP_PUSH                  }, push_to_dup     },
+  { 1, { OP_SLIDE                          }, slide_zero      },
+  { 2, { OP_JMP,  OP_LABEL                 }, jump_to_next    },
+  { 2, { OP_JZ,   OP_LABEL                 }, branch_to_next  },
+  { 2, { OP_JNEG, OP_LABEL                 }, branch_to_next  },
+};
+static const int g_rule_count = sizeof(g_rules) / sizeof(rule_t);
+
+static int  count_instructions(inst_t *insts, int count);
+static bool apply_rules(inst_t *insts, int count);
+static int  sweep(inst_t *insts, int count);
+
+/* rewrites the instructions in place; sweeping only moves them down */
+int peephole_optimize(insts_t *instructions) {
+  inst_t *insts = insts_data(instructions);
+  int count = insts_count(instructions);
+  int before;
+
+  before = count_instructions(insts, count);
+
+  count = sweep(insts, count);
+  while (apply_rules(insts, count)) {
+    count = sweep(insts, count);
+  }
+
+  insts_truncate(instructions, count);
+
+  return before - count;
+}
+
+static int count_instructions(inst_t *insts, int count) {
+  int n = 0;
+  for (int i = 0; i < count; ++i) {
+    if (insts[i].opcode != OP_NOP) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+static bool matches(const rule_t *rule, inst_t *insts, int count, int i) {
+  if (i + rule->length > count) {
+    return false;
+  }
+  for (int k = 0; k < rule->length; ++k) {
+    if (insts[i + k].opcode != rule->opcodes[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool apply_rules(inst_t *insts, int count) {
+  bool changed = false;
+
+  for (int i = 0; i < count; ++i) {
+    for (int r = 0; r < g_rule_count; ++r) {
+      const rule_t *rule = &g_rules[r];
+      if (matches(rule, insts, count, i) && rule->rewrite(&insts[i])) {
+        changed = true;
+        break;
+      }
+    }
+  }
+
+  return changed;
+}
+
+/* drop NOPs, returning the new instruction count */
+static int sweep(inst_t *insts, int count) {
+  int n = 0;
+  for (int i = 0; i < count; ++i) {
+    if (insts[i].opcode != OP_NOP) {
+      insts[n++] = insts[i];
+    }
+  }
+  return n;
+}
+
+static bool fits_int(long long value) {
+  return value >= INT_MIN && value <= INT_MAX;
+}
+
+static long long floor_div(long long x, long long y) {
+  long long q = x / y;
+  return (x % y != 0 && (x < 0) != (y < 0)) ? q - 1 : q;
+}
+
+static long long floor_mod(long long x, long long y) {
+  long long r = x % y;
+  return (r != 0 && (r < 0) != (y < 0)) ? r + y : r;
+}
+
+/* PUSH n; POP, DUP; POP, COPY n; POP, SWAP; SWAP */
+static bool remove_pair(inst_t *window) {
+  window[0].opcode = OP_NOP;
+  window[1].opcode = OP_NOP;
+  return true;
+}
+
+/* SWAP; ADD, SWAP; MUL */
+static bool remove_first(inst_t *window) {
+  window[0].opcode = OP_NOP;
+  return true;
+}
+
+/* PUSH 0; ADD, PUSH 0; SUB, PUSH 1; MUL, PUSH 1; DIV */
+static bool remove_identity(inst_t *window) {
+  int value = window[0].value;
+  opcode_t opcode = window[1].opcode;
+
+  if ((value == 0 && (opcode == OP_ADD || opcode == OP_SUB)) ||
+      (value == 1 && (opcode == OP_MUL || opcode == OP_DIV))) {
+    return remove_pair(window);
+  }
+  return false;
+}
+
+/* PUSH x; PUSH y; op --> PUSH (x op y) */
+static bool fold_constants(inst_t *window) {
+  long long x = window[0].value;
+  long long y = window[1].value;
+  long long z;
+
+  switch (window[2].opcode) {
+  case OP_ADD: z = x + y; break;
+  case OP_SUB: z = x - y; break;
+  case OP_MUL: z = x * y; break;
+  case OP_DIV:
+    if (y == 0) {
+      return false;
+    }
+    z = floor_div(x, y);
+    break;
+  case OP_MOD:
+    if (y == 0) {
+      return false;
+    }
+    z = floor_mod(x, y);
+    break;
+  default:
+    return false;
+  }
+
+  if (!fits_int(z)) {
+    return false;
+  }
+
+  window[0].value = (int)z;
+  window[1].opcode = OP_NOP;
+  window[2].opcode = OP_NOP;
+  return true;
+}
+
+/* PUSH x; ADD; PUSH y; ADD --> PUSH (x + y); ADD */
+static bool fold_additions(inst_t *window) {
+  long long z = (long long)window[0].value + window[2].value;
+
+  if (!fits_int(z)) {
+    return false;
+  }
+  window[0].value = (int)z;
+  window[2].opcode = OP_NOP;
+  window[3].opcode = OP_NOP;
+  return true;
+}
+
+/* COPY 0 --> DUP */
+static bool copy_to_dup(inst_t *window) {
+  if (window[0].value != 0) {
+    return false;
+  }
+  window[0].opcode = OP_DUP;
+  return true;
+}
+
+/* PUSH x; PUSH x --> PUSH x; DUP */
+static bool push_to_dup(inst_t *window) {
+  if (window[0].value != window[1].value) {
+    return false;
+  }
+  window[1].opcode = OP_DUP;
+  return true;
+}
+
+/* SLIDE 0 */
+static bool slide_zero(inst_t *window) {
+  if (window[0].value != 0) {
+    return false;
+  }
+  window[0].opcode = OP_NOP;
+  return true;
+}
+
+/* JMP L; L: */
+static bool jump_to_next(inst_t *window) {
+  if (window[0].label != window[1].label) {
+    return false;
+  }
+  window[0].opcode = OP_NOP;
+  return true;
+}
+
+/* JZ L; L: --> POP; L: */
+static bool branch_to_next(inst_t *window) {
+  if (window[0].label != window[1].label) {
+    return false;
+  }
+  window[0].opcode = OP_POP;
+  return true;
+}
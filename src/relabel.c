@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include "relabel.h"
+#include "inst.h"
+#include "utils/memory.h"
+
+/*
+ * Whitespace writes a label as its number in binary, so its length is the
+ * number's bit length. Labels are renumbered by how often they occur, the
+ * label definition included: the most frequent ones get the smallest
+ * numbers and so the shortest encodings. Labels are expected to be numbered
+ * densely, as codegen leaves them.
+ */
+typedef struct {
+  int label;
+  int count;
+} usage_t;
+
+static int  compare_usage(const void *a, const void *b);
+static int  encoded_length(int label);
+
+/* returns the number of label symbols saved in the whitespace encoding */
+int relabel_optimize(insts_t *instructions) {
+  inst_t *insts = insts_data(instructions);
+  int count = insts_count(instructions);
+  int label_count = 0;
+  usage_t *usages;
+  int *numbers;
+  int saved = 0;
+
+  for (int i = 0; i < count; ++i) {
+    if (inst_has_label(&insts[i]) && insts[i].label >= label_count) {
+      label_count = insts[i].label + 1;
+    }
+  }
+
+  usages = (usage_t *)AK_MEM_MALLOC(sizeof(usage_t) * (label_count + 1));
+  numbers = (int *)AK_MEM_MALLOC(sizeof(int) * (label_count + 1));
+  for (int i = 0; i < label_count; ++i) {
+    usages[i].label = i;
+    usages[i].count = 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    if (inst_has_label(&insts[i])) {
+      usages[insts[i].label].count++;
+    }
+  }
+
+  qsort(usages, label_count, sizeof(usage_t), compare_usage);
+
+  for (int i = 0; i < label_count; ++i) {
+    numbers[usages[i].label] = i;
+    saved += usages[i].count * (encoded_length(usages[i].label) - encoded_length(i));
+  }
+  for (int i = 0; i < count; ++i) {
+    if (inst_has_label(&insts[i])) {
+      insts[i].label = numbers[insts[i].label];
+    }
+  }
+
+  AK_MEM_FREE(usages);
+  AK_MEM_FREE(numbers);
+
+  return saved;
+}
+
+/* most used first; ties keep the old order so the result is deterministic */
+static int compare_usage(const void *a, const void *b) {
+  const usage_t *u1 = (const usage_t *)a;
+  const usage_t *u2 = (const usage_t *)b;
+
+  if (u1->count != u2->count) {
+    return u1->count > u2->count ? -1 : 1;
+  }
+  return u1->label < u2->label ? -1 : u1->label > u2->label;
+}
+
+/* symbols encoding the label, not counting the terminating newline */
+static int encoded_length(int label) {
+  int length = 1;
+  while (label > 1) {
+    label >>= 1;
+    ++length;
+  }
+  return length;
+}
@@ -0,0 +1,163 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include "tokens.h"
+#include "lexer.h"
+#include "utils/memory.h"
+
+#define MIN_CAPACITY ( 64 )
+
+/*
+ * Struct of arrays, so a scan over token types touches one byte per token.
+ * Types are stored signed as TT_EOF is -1. EOF and unknown tokens have no text in the source; their offset is -1 and
+ * their text is the lexer's placeholder. The lexer errors are kept aside with
+ * the index of their token; the first reported ones are those before
+ * next_error.
+ */
+struct tokens_t {
+  const char    *src;
+  signed char   *ttypes;
+  int           *offsets;
+  int           *lengths;
+  int           *values;
+  location_t    *locations;
+  int            count;
+  int            capacity;
+  int            error_count;
+  int           *error_tokens;
+  location_t    *error_locations;
+  int            next_error;
+};
+
+static void grow(tokens_t *tokens);
+static void add_error(tokens_t *tokens, int i, location_t location);
+
+tokens_t *tokens_new(const char *src, size_t length) {
+  tokens_t *tokens = (tokens_t *)AK_MEM_MALLOC(sizeof(tokens_t));
+  lexer_t *lexer = lexer_new(src, length);
+  bool eof = false;
+
+  tokens->src = src;
+  tokens->ttypes = NULL;
+  tokens->offsets = NULL;
+  tokens->lengths = NULL;
+  tokens->values = NULL;
+  tokens->locations = NULL;
+  tokens->count = 0;
+  tokens->error_count = 0;
+  tokens->error_tokens = NULL;
+  tokens->error_locations = NULL;
+  tokens->next_error = 0;
+  /* about one token per four bytes of source */
+  tokens->capacity = length / 4 > MIN_CAPACITY ? (int)(length / 4) : MIN_CAPACITY;
+  grow(tokens);
+
+  while (!eof) {
+    int i = tokens->count;
+    ttype_t ttype;
+
+    if (i == tokens->capacity) {
+      tokens->capacity *= 2;
+      grow(tokens);
+    }
+
+    lexer_next(lexer);
+    ttype = lexer_ttype(lexer);
+    tokens->ttypes[i] = (signed char)ttype;
+    tokens->offsets[i] = (ttype == TT_EOF || ttype == TT_UNKNOWN) ? -1 : (int)(lexer_text(lexer) - src);
+    tokens->lengths[i] = lexer_text_length(lexer);
+    tokens->values[i] = lexer_int_value(lexer);
+    tokens->locations[i] = lexer_get_location(lexer);
+    tokens->count++;
+
+    if (ttype == TT_UNKNOWN) {
+      add_error(tokens, i, lexer_get_error_location(lexer));
+    }
+
+    eof = ttype == TT_EOF;
+  }
+
+  lexer_release(&lexer);
+
+  return tokens;
+}
+
+void tokens_release(tokens_t **ptokens) {
+  tokens_t *tokens = *ptokens;
+  AK_MEM_FREE(tokens->ttypes);
+  AK_MEM_FREE(tokens->offsets);
+  AK_MEM_FREE(tokens->lengths);
+  AK_MEM_FREE(tokens->values);
+  AK_MEM_FREE(tokens->locations);
+  AK_MEM_FREE(tokens->error_tokens);
+  AK_MEM_FREE(tokens->error_locations);
+  AK_MEM_FREE(tokens);
+  *ptokens = NULL;
+}
+
+int tokens_count(tokens_t *tokens) {
+  return tokens->count;
+}
+
+ttype_t tokens_ttype(tokens_t *tokens, int i) {
+  return (ttype_t)tokens->ttypes[i];
+}
+
+/* not NUL-terminated, see tokens_text_length */
+const char *tokens_text(tokens_t *tokens, int i) {
+  if (tokens->offsets[i] < 0) {
+    return tokens_ttype(tokens, i) == TT_EOF ? "<EOF>" : "<UNKNOWN>";
+  }
+  return tokens->src + tokens->offsets[i];
+}
+
+int tokens_text_length(tokens_t *tokens, int i) {
+  return tokens->lengths[i];
+}
+
+int tokens_int_value(tokens_t *tokens, int i) {
+  return tokens->values[i];
+}
+
+/* the location just past the token, as the lexer reports it */
+location_t tokens_location(tokens_t *tokens, int i) {
+  return tokens->locations[i];
+}
+
+int tokens_get_error_count(tokens_t *tokens) {
+  return tokens->error_count;
+}
+
+/* prints the lexer errors of tokens up to i which have not been printed yet */
+void tokens_report_errors(tokens_t *tokens, int i, sink_t *messages) {
+  static const char *format = "error: unrecognizable character '%c' (line:%d,column:%d)\n";
+
+  while (tokens->next_error < tokens->error_count && tokens->error_tokens[tokens->next_error] <= i) {
+    int k = tokens->next_error++;
+    int c = tokens->values[tokens->error_tokens[k]];
+    location_t location = tokens->error_locations[k];
+
+    if (messages) {
+      sink_printf(messages, format, c, location.line, location.column);
+    }
+    else {
+      fprintf(stderr, format, c, location.line, location.column);
+    }
+  }
+}
+
+static void grow(tokens_t *tokens) {
+  int capacity = tokens->capacity;
+  tokens->ttypes = (signed char *)AK_MEM_REALLOC(tokens->ttypes, sizeof(signed char) * capacity);
+  tokens->offsets = (int *)AK_MEM_REALLOC(tokens->offsets, sizeof(int) * capacity);
+  tokens->lengths = (int *)AK_MEM_REALLOC(tokens->lengths, sizeof(int) * capacity);
+  tokens->values = (int *)AK_MEM_REALLOC(tokens->values, sizeof(int) * capacity);
+  tokens->locations = (location_t *)AK_MEM_REALLOC(tokens->locations, sizeof(location_t) * capacity);
+}
+
+static void add_error(tokens_t *tokens, int i, location_t location) {
+  int n = tokens->error_count++;
+  tokens->error_tokens = (int *)AK_MEM_REALLOC(tokens->error_tokens, sizeof(int) * tokens->error_count);
+  tokens->error_locations = (location_t *)AK_MEM_REALLOC(tokens->error_locations, sizeof(location_t) * tokens->error_count);
+  tokens->error_tokens[n] = i;
+  tokens->error_locations[n] = location;
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include "utils/arena.h"
+#include "utils/memory.h"
+
+/*
+ * A bump allocator over a list of chunks. Allocations are never freed one
+ * by one; releasing the arena frees every chunk at once.
+ */
+typedef union {
+  long long ll;
+  double    d;
+  void     *p;
+} align_t;
+
+#define ALIGN_UP(SIZE) ( ((SIZE) + sizeof(align_t) - 1) / sizeof(align_t) * sizeof(align_t) )
+
+typedef struct chunk_t chunk_t;
+
+struct chunk_t {
+  chunk_t *next;
+  size_t   size;
+  size_t   used;
+  align_t  data[];
+};
+
+struct arena_t {
+  chunk_t *chunks;
+  size_t   chunk_size;
+};
+
+arena_t *arena_new(size_t chunk_size) {
+  arena_t *arena = (arena_t *)AK_MEM_MALLOC(sizeof(arena_t));
+  arena->chunks = NULL;
+  arena->chunk_size = ALIGN_UP(chunk_size);
+  return arena;
+}
+
+void arena_release(arena_t **parena) {
+  chunk_t *chunk = (*parena)->chunks;
+
+  while (chunk) {
+    chunk_t *next = chunk->next;
+    AK_MEM_FREE(chunk);
+    chunk = next;
+  }
+
+  AK_MEM_FREE(*parena);
+  *parena = NULL;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+  chunk_t *chunk = arena->chunks;
+  void *ptr;
+
+  size = ALIGN_UP(size);
+
+  if (!chunk || chunk->size - chunk->used < size) {
+    size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+    chunk = (chunk_t *)AK_MEM_MALLOC(sizeof(chunk_t) + chunk_size);
+    chunk->next = arena->chunks;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    arena->chunks = chunk;
+  }
+
+  ptr = (char *)chunk->data + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
@@ -37,6 +37,16 @@ void *array_get(array_t *array, int index) {
   return array->data[index];
 }
 
+void array_set(array_t *array, int index, void *item) {
+  array->data[index] = item;
+}
+
+void array_truncate(array_t *array, int count) {
+  if (count < array->count) {
+    array->count = count;
+  }
+}
+
 array_t *array_concat(array_t *array1, array_t *array2) {
   array_t *array = array_new(array1->count + array2->count);
   for (int i = 0; i < array1->count; ++i) {
@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,7 +13,9 @@ struct mem_t {
   mem_t      *next;
 };
 
-static mem_t *g_mems = NULL;
+/* compilation may run on several threads, the list is guarded by g_lock */
+static mem_t          *g_mems = NULL;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void allocate(void *ptr, int size, const char *file, int line, const char *func) {
   mem_t *add;
@@ -72,37 +75,53 @@ static void release(void *ptr, const char *file, int line, const char *func) {
 }
 
 void *akarin_malloc(size_t size, const char *file, int line, const char *func) {
-  void *ptr = malloc(size);
+  void *ptr;
+  pthread_mutex_lock(&g_lock);
+  ptr = malloc(size);
   allocate(ptr, size, file, line, func);
+  pthread_mutex_unlock(&g_lock);
   return ptr;
 }
 
 void *akarin_calloc(size_t n, size_t size, const char *file, int line, const char *func) {
-  void *ptr = calloc(n, size);
+  void *ptr;
+  pthread_mutex_lock(&g_lock);
+  ptr = calloc(n, size);
   allocate(ptr, n * size, file, line, func);
+  pthread_mutex_unlock(&g_lock);
   return ptr;
 }
 
 void *akarin_realloc(void *ptr, size_t size, const char *file, int line, const char *func) {
-  void *newptr = realloc(ptr, size);
+  void *newptr;
+  pthread_mutex_lock(&g_lock);
+  newptr = realloc(ptr, size);
   release(ptr, file, line, func);
   allocate(newptr, size, file, line, func);
+  pthread_mutex_unlock(&g_lock);
   return newptr;
 }
 
 void akarin_free(void *ptr, const char *file, int line, const char *func) {
+  pthread_mutex_lock(&g_lock);
   free(ptr);
   release(ptr, file, line, func);
+  pthread_mutex_unlock(&g_lock);
 }
 
 char *akarin_strdup(const char *str, const char *file, int line, const char *func) {
-  char *newstr = strdup(str);
+  char *newstr;
+  pthread_mutex_lock(&g_lock);
+  newstr = strdup(str);
   allocate(newstr, strlen(newstr) + 1, file, line, func);
+  pthread_mutex_unlock(&g_lock);
   return newstr;
 }
 
 void akarin_memory_print(void) {
-  mem_t *mem = g_mems;
+  mem_t *mem;
+  pthread_mutex_lock(&g_lock);
+  mem = g_mems;
   if (mem) {
     fprintf(stderr, "\x1B[31;1mDetected Memory Leaks\n");
     while (mem) {
@@ -111,4 +130,5 @@ void akarin_memory_print(void) {
     }
     fprintf(stderr, "\x1B[0m");
   }
+  pthread_mutex_unlock(&g_lock);
 }
@@ -0,0 +1,70 @@
+#include <pthread.h>
+#include "utils/pool.h"
+#include "utils/memory.h"
+
+typedef struct {
+  pthread_mutex_t lock;
+  int             next;
+  int             count;
+  pool_task_t     task;
+  void           *context;
+} pool_t;
+
+static void *worker(void *arg);
+
+void pool_run(int jobs, int count, pool_task_t task, void *context) {
+  pool_t pool;
+  pthread_t *threads;
+  int started = 0;
+
+  if (jobs > count) {
+    jobs = count;
+  }
+
+  if (jobs <= 1) {
+    for (int i = 0; i < count; ++i) {
+      task(context, i);
+    }
+    return;
+  }
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pool.next = 0;
+  pool.count = count;
+  pool.task = task;
+  pool.context = context;
+
+  /* the calling thread works too, so jobs - 1 threads are started */
+  threads = (pthread_t *)AK_MEM_MALLOC(sizeof(pthread_t) * (jobs - 1));
+  for (int i = 0; i < jobs - 1; ++i) {
+    if (pthread_create(&threads[started], NULL, worker, &pool) == 0) {
+      ++started;
+    }
+  }
+
+  worker(&pool);
+
+  for (int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  AK_MEM_FREE(threads);
+  pthread_mutex_destroy(&pool.lock);
+}
+
+static void *worker(void *arg) {
+  pool_t *pool = (pool_t *)arg;
+
+  for (;;) {
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    i = pool->next < pool->count ? pool->next++ : -1;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (i < 0) {
+      return NULL;
+    }
+    pool->task(pool->context, i);
+  }
+}
@@ -0,0 +1,132 @@
+#include <stddef.h>
+#include "utils/scan.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(AK_NO_SIMD)
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* the same set of characters isspace accepts in the C locale */
+static int is_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static const char *scalar_skip_space(const char *p, const char *end, int *lines, const char **line_start) {
+  for (; p < end && is_space(*p); ++p) {
+    if (*p == '\n') {
+      ++*lines;
+      *line_start = p + 1;
+    }
+  }
+  return p;
+}
+
+static const char *scalar_find_newline(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    ++p;
+  }
+  return p;
+}
+
+#if !defined(HAVE_X86_SIMD)
+static const scanner_t g_scalar = { "scalar", scalar_skip_space, scalar_find_newline };
+#endif
+
+#if defined(HAVE_X86_SIMD)
+/* account for the newlines marked in a bit mask of a block */
+static void count_lines(const char *block, unsigned int newlines, int *lines, const char **line_start) {
+  if (newlines) {
+    *lines += __builtin_popcount(newlines);
+    *line_start = block + (31 - __builtin_clz(newlines)) + 1;
+  }
+}
+
+/*
+ * Whitespace is ' ' or a byte in '\t'..'\r'. The range test uses signed
+ * compares, which also rejects bytes >= 0x80. Only whole blocks inside the
+ * buffer are loaded; the tail is left to the scalar loop.
+ */
+static const char *sse2_skip_space(const char *p, const char *end, int *lines, const char **line_start) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i lower = _mm_set1_epi8('\t' - 1);
+  const __m128i upper = _mm_set1_epi8('\r' + 1);
+
+  for (; end - p >= 16; p += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(b, space),
+                              _mm_and_si128(_mm_cmpgt_epi8(b, lower), _mm_cmplt_epi8(b, upper)));
+    unsigned int ws_mask = (unsigned int)_mm_movemask_epi8(ws);
+    unsigned int nl_mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(b, newline));
+
+    if (ws_mask != 0xFFFFu) {
+      int n = __builtin_ctz(~ws_mask);
+      count_lines(p, nl_mask & ((1u << n) - 1), lines, line_start);
+      return p + n;
+    }
+    count_lines(p, nl_mask, lines, line_start);
+  }
+  return scalar_skip_space(p, end, lines, line_start);
+}
+
+static const char *sse2_find_newline(const char *p, const char *end) {
+  const __m128i newline = _mm_set1_epi8('\n');
+
+  for (; end - p >= 16; p += 16) {
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), newline));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return scalar_find_newline(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_skip_space(const char *p, const char *end, int *lines, const char **line_start) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i lower = _mm256_set1_epi8('\t' - 1);
+  const __m256i upper = _mm256_set1_epi8('\r' + 1);
+
+  for (; end - p >= 32; p += 32) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)p);
+    __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(b, space),
+                                 _mm256_and_si256(_mm256_cmpgt_epi8(b, lower), _mm256_cmpgt_epi8(upper, b)));
+    unsigned int ws_mask = (unsigned int)_mm256_movemask_epi8(ws);
+    unsigned int nl_mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, newline));
+
+    if (ws_mask != 0xFFFFFFFFu) {
+      int n = __builtin_ctz(~ws_mask);
+      count_lines(p, nl_mask & ((1u << n) - 1), lines, line_start);
+      return p + n;
+    }
+    count_lines(p, nl_mask, lines, line_start);
+  }
+  return sse2_skip_space(p, end, lines, line_start);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_find_newline(const char *p, const char *end) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+
+  for (; end - p >= 32; p += 32) {
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), newline));
+    if (mask) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return sse2_find_newline(p, end);
+}
+
+static const scanner_t g_sse2 = { "sse2", sse2_skip_space, sse2_find_newline };
+static const scanner_t g_avx2 = { "avx2", avx2_skip_space, avx2_find_newline };
+#endif
+
+const scanner_t *scanner_get(void) {
+#if defined(HAVE_X86_SIMD)
+  /* SSE2 is part of the x86-64 baseline */
+  return __builtin_cpu_supports("avx2") ? &g_avx2 : &g_sse2;
+#else
+  return &g_scalar;
+#endif
+}
@@ -0,0 +1,127 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "utils/sink.h"
+#include "utils/memory.h"
+
+#define INITIAL_MEMORY_CAPACITY ( 4096 )
+
+typedef enum {
+  SINK_FILE,
+  SINK_MEMORY,
+  SINK_CALLBACK
+} sink_type_t;
+
+struct sink_t {
+  sink_type_t      type;
+  FILE            *fp;
+  char            *data;
+  size_t           size;
+  size_t           capacity;
+  sink_callback_t  callback;
+  void            *context;
+};
+
+static sink_t *sink_new(sink_type_t type) {
+  sink_t *sink = (sink_t *)AK_MEM_MALLOC(sizeof(sink_t));
+  sink->type = type;
+  sink->fp = NULL;
+  sink->data = NULL;
+  sink->size = 0;
+  sink->capacity = 0;
+  sink->callback = NULL;
+  sink->context = NULL;
+  return sink;
+}
+
+sink_t *sink_new_file(FILE *fp) {
+  sink_t *sink = sink_new(SINK_FILE);
+  sink->fp = fp;
+  return sink;
+}
+
+sink_t *sink_new_memory(void) {
+  sink_t *sink = sink_new(SINK_MEMORY);
+  sink->capacity = INITIAL_MEMORY_CAPACITY;
+  sink->data = (char *)AK_MEM_MALLOC(sink->capacity);
+  sink->data[0] = '\0';
+  return sink;
+}
+
+sink_t *sink_new_callback(sink_callback_t callback, void *context) {
+  sink_t *sink = sink_new(SINK_CALLBACK);
+  sink->callback = callback;
+  sink->context = context;
+  return sink;
+}
+
+/* the stream of a file sink is not closed */
+void sink_release(sink_t **psink) {
+  sink_t *sink = *psink;
+
+  if (sink->data) {
+    AK_MEM_FREE(sink->data);
+  }
+  AK_MEM_FREE(sink);
+  *psink = NULL;
+}
+
+void sink_write(sink_t *sink, const char *data, size_t length) {
+  switch (sink->type) {
+  case SINK_FILE:
+    fwrite(data, 1, length, sink->fp);
+    break;
+  case SINK_MEMORY:
+    /* keep room for a terminating NUL */
+    if (sink->capacity - sink->size <= length) {
+      while (sink->capacity - sink->size <= length) {
+        sink->capacity *= 2;
+      }
+      sink->data = (char *)AK_MEM_REALLOC(sink->data, sink->capacity);
+    }
+    memcpy(sink->data + sink->size, data, length);
+    sink->size += length;
+    sink->data[sink->size] = '\0';
+    break;
+  case SINK_CALLBACK:
+    sink->callback(sink->context, data, length);
+    break;
+  }
+}
+
+void sink_printf(sink_t *sink, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  sink_vprintf(sink, fmt, args);
+  va_end(args);
+}
+
+void sink_vprintf(sink_t *sink, const char *fmt, va_list args) {
+  va_list copy;
+  int length;
+  char *text;
+
+  va_copy(copy, args);
+  length = vsnprintf(NULL, 0, fmt, copy);
+  va_end(copy);
+
+  text = (char *)AK_MEM_MALLOC(length + 1);
+  vsnprintf(text, length + 1, fmt, args);
+  sink_write(sink, text, length);
+  AK_MEM_FREE(text);
+}
+
+void sink_flush(sink_t *sink) {
+  if (sink->type == SINK_FILE) {
+    fflush(sink->fp);
+  }
+}
+
+/* contents of a memory sink, NUL-terminated; NULL for other sinks */
+const char *sink_get_data(sink_t *sink) {
+  return sink->data;
+}
+
+size_t sink_get_size(sink_t *sink) {
+  return sink->size;
+}
@@ -0,0 +1,103 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils/source.h"
+#include "utils/memory.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SOURCE_MMAP
+#endif
+
+#define READ_CHUNK_SIZE ( 64 * 1024 )
+
+struct source_t {
+  char   *data;
+  size_t  size;
+  bool    mapped;
+};
+
+/* returns NULL if the file cannot be opened */
+source_t *source_open(const char *path) {
+  source_t *source;
+  FILE *fp;
+
+#ifdef SOURCE_MMAP
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      close(fd);
+      source = (source_t *)AK_MEM_MALLOC(sizeof(source_t));
+      source->data = (char *)data;
+      source->size = (size_t)st.st_size;
+      source->mapped = true;
+      return source;
+    }
+  }
+  close(fd);
+#endif
+
+  fp = fopen(path, "r");
+  if (!fp) {
+    return NULL;
+  }
+  source = source_read(fp);
+  fclose(fp);
+  return source;
+}
+
+source_t *source_read(FILE *fp) {
+  source_t *source = (source_t *)AK_MEM_MALLOC(sizeof(source_t));
+  size_t capacity = READ_CHUNK_SIZE;
+  size_t n;
+
+  source->data = (char *)AK_MEM_MALLOC(capacity);
+  source->size = 0;
+  source->mapped = false;
+
+  while ((n = fread(source->data + source->size, 1, capacity - source->size, fp)) > 0) {
+    source->size += n;
+    if (source->size == capacity) {
+      capacity *= 2;
+      source->data = (char *)AK_MEM_REALLOC(source->data, capacity);
+    }
+  }
+
+  return source;
+}
+
+void source_release(source_t **psource) {
+  source_t *source = *psource;
+
+#ifdef SOURCE_MMAP
+  if (source->mapped) {
+    munmap(source->data, source->size);
+  }
+  else {
+    AK_MEM_FREE(source->data);
+  }
+#else
+  AK_MEM_FREE(source->data);
+#endif
+
+  AK_MEM_FREE(source);
+  *psource = NULL;
+}
+
+const char *source_get_data(source_t *source) {
+  return source->data;
+}
+
+size_t source_get_size(source_t *source) {
+  return source->size;
+}
@@ -0,0 +1,150 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils/symbol.h"
+#include "utils/arena.h"
+#include "utils/memory.h"
+
+#define INITIAL_SLOT_COUNT ( 1024 )
+#define NAME_CHUNK_SIZE    ( 16 * 1024 )
+
+/*
+ * Names are kept in an arena and indexed by symbol. Lookup goes through an
+ * open-addressing table of symbols with linear probing, kept at most half
+ * full. Files may be compiled on several threads at once, so every access
+ * to the table holds g_lock. g_users counts the compilations holding
+ * symbols; the last one to finish frees the table, so a long-running host
+ * does not keep the names of every program it has compiled.
+ */
+static arena_t        *g_arena = NULL;
+static const char    **g_names = NULL;
+static unsigned int   *g_hashes = NULL;
+static int             g_count = 0;
+static int             g_capacity = 0;
+static symbol_t       *g_slots = NULL;
+static int             g_slot_count = 0;
+static int             g_users = 0;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int hash(const char *name, size_t length) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return h;
+}
+
+static void allocate_slots(int slot_count) {
+  g_slots = (symbol_t *)AK_MEM_MALLOC(sizeof(symbol_t) * slot_count);
+  g_slot_count = slot_count;
+  for (int i = 0; i < slot_count; ++i) {
+    g_slots[i] = SYMBOL_NONE;
+  }
+}
+
+static void rehash(void) {
+  AK_MEM_FREE(g_slots);
+  allocate_slots(g_slot_count * 2);
+
+  for (symbol_t symbol = 0; symbol < g_count; ++symbol) {
+    unsigned int mask = g_slot_count - 1;
+    unsigned int i = g_hashes[symbol] & mask;
+    while (g_slots[i] != SYMBOL_NONE) {
+      i = (i + 1) & mask;
+    }
+    g_slots[i] = symbol;
+  }
+}
+
+static symbol_t intern(const char *name, size_t length) {
+  unsigned int h = hash(name, length);
+  unsigned int mask;
+  unsigned int i;
+  char *copy;
+
+  if (!g_slots) {
+    g_arena = arena_new(NAME_CHUNK_SIZE);
+    allocate_slots(INITIAL_SLOT_COUNT);
+  }
+
+  mask = g_slot_count - 1;
+  for (i = h & mask; g_slots[i] != SYMBOL_NONE; i = (i + 1) & mask) {
+    symbol_t symbol = g_slots[i];
+    if (g_hashes[symbol] == h && strncmp(g_names[symbol], name, length) == 0 && g_names[symbol][length] == '\0') {
+      return symbol;
+    }
+  }
+
+  if (g_count == g_capacity) {
+    g_capacity = g_capacity > 0 ? g_capacity * 2 : INITIAL_SLOT_COUNT / 2;
+    g_names = (const char **)AK_MEM_REALLOC((void *)g_names, sizeof(const char *) * g_capacity);
+    g_hashes = (unsigned int *)AK_MEM_REALLOC(g_hashes, sizeof(unsigned int) * g_capacity);
+  }
+
+  copy = (char *)arena_alloc(g_arena, length + 1);
+  memcpy(copy, name, length);
+  copy[length] = '\0';
+
+  g_names[g_count] = copy;
+  g_hashes[g_count] = h;
+  g_slots[i] = g_count;
+
+  if (++g_count * 2 > g_slot_count) {
+    rehash();
+  }
+
+  return g_count - 1;
+}
+
+symbol_t symbol_intern(const char *name) {
+  return symbol_intern_n(name, strlen(name));
+}
+
+/* name need not be NUL-terminated */
+symbol_t symbol_intern_n(const char *name, size_t length) {
+  symbol_t symbol;
+
+  pthread_mutex_lock(&g_lock);
+  symbol = intern(name, length);
+  pthread_mutex_unlock(&g_lock);
+
+  return symbol;
+}
+
+const char *symbol_get_name(symbol_t symbol) {
+  const char *name;
+
+  /* g_names may be moved by an intern on another thread */
+  pthread_mutex_lock(&g_lock);
+  name = g_names[symbol];
+  pthread_mutex_unlock(&g_lock);
+
+  return name;
+}
+
+void symbol_acquire(void) {
+  pthread_mutex_lock(&g_lock);
+  ++g_users;
+  pthread_mutex_unlock(&g_lock);
+}
+
+/* frees the table, invalidating every symbol, once no compilation holds it */
+void symbol_release(void) {
+  pthread_mutex_lock(&g_lock);
+
+  if (--g_users == 0 && g_slots) {
+    arena_release(&g_arena);
+    AK_MEM_FREE((void *)g_names);
+    AK_MEM_FREE(g_hashes);
+    AK_MEM_FREE(g_slots);
+
+    g_names = NULL;
+    g_hashes = NULL;
+    g_count = 0;
+    g_capacity = 0;
+    g_slots = NULL;
+    g_slot_count = 0;
+  }
+
+  pthread_mutex_unlock(&g_lock);
+}
@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include "utils/symmap.h"
+#include "utils/memory.h"
+
+typedef struct {
+  symbol_t  key;
+  void     *value;
+} slot_t;
+
+/* slot_count is a power of two and the map is kept at most half full */
+struct symmap_t {
+  int     count;
+  int     slot_count;
+  slot_t *slots;
+};
+
+static void allocate_slots(symmap_t *map, int slot_count) {
+  map->slot_count = slot_count;
+  map->slots = (slot_t *)AK_MEM_MALLOC(sizeof(slot_t) * slot_count);
+  for (int i = 0; i < slot_count; ++i) {
+    map->slots[i].key = SYMBOL_NONE;
+    map->slots[i].value = NULL;
+  }
+}
+
+/* symbols are dense small integers, so spread them by Fibonacci hashing */
+static unsigned int first_slot(symmap_t *map, symbol_t key) {
+  return ((unsigned int)key * 2654435769u) & (map->slot_count - 1);
+}
+
+static slot_t *find_slot(symmap_t *map, symbol_t key) {
+  unsigned int mask = map->slot_count - 1;
+  unsigned int i = first_slot(map, key);
+
+  while (map->slots[i].key != SYMBOL_NONE && map->slots[i].key != key) {
+    i = (i + 1) & mask;
+  }
+  return &map->slots[i];
+}
+
+symmap_t *symmap_new(int initial_capacity) {
+  symmap_t *map = (symmap_t *)AK_MEM_MALLOC(sizeof(symmap_t));
+  int slot_count = 8;
+
+  while (slot_count < initial_capacity * 2) {
+    slot_count *= 2;
+  }
+
+  map->count = 0;
+  allocate_slots(map, slot_count);
+  return map;
+}
+
+void symmap_release(symmap_t **pmap) {
+  AK_MEM_FREE((*pmap)->slots);
+  AK_MEM_FREE(*pmap);
+  *pmap = NULL;
+}
+
+void *symmap_get(symmap_t *map, symbol_t key) {
+  return find_slot(map, key)->value;
+}
+
+void symmap_put(symmap_t *map, symbol_t key, void *value) {
+  slot_t *slot = find_slot(map, key);
+
+  if (slot->key == key) {
+    slot->value = value;
+    return;
+  }
+
+  slot->key = key;
+  slot->value = value;
+
+  if (++map->count * 2 > map->slot_count) {
+    slot_t *old_slots = map->slots;
+    int old_slot_count = map->slot_count;
+
+    allocate_slots(map, old_slot_count * 2);
+    for (int i = 0; i < old_slot_count; ++i) {
+      if (old_slots[i].key != SYMBOL_NONE) {
+        *find_slot(map, old_slots[i].key) = old_slots[i];
+      }
+    }
+    AK_MEM_FREE(old_slots);
+  }
+}
+
+int symmap_count(symmap_t *map) {
+  return map->count;
+}
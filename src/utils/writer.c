@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "utils/writer.h"
+#include "utils/memory.h"
+
+#define BUFFER_SIZE ( 64 * 1024 )
+
+struct writer_t {
+  sink_t *sink;
+  size_t  used;
+  char    buffer[BUFFER_SIZE];
+};
+
+writer_t *writer_new(sink_t *sink) {
+  writer_t *writer = (writer_t *)AK_MEM_MALLOC(sizeof(writer_t));
+  writer->sink = sink;
+  writer->used = 0;
+  return writer;
+}
+
+/* pending output is flushed on release */
+void writer_release(writer_t **pwriter) {
+  writer_flush(*pwriter);
+  AK_MEM_FREE(*pwriter);
+  *pwriter = NULL;
+}
+
+void writer_write(writer_t *writer, const char *data, size_t length) {
+  if (BUFFER_SIZE - writer->used < length) {
+    writer_flush(writer);
+    if (length >= BUFFER_SIZE) {
+      sink_write(writer->sink, data, length);
+      return;
+    }
+  }
+  memcpy(writer->buffer + writer->used, data, length);
+  writer->used += length;
+}
+
+void writer_putc(writer_t *writer, char c) {
+  if (writer->used == BUFFER_SIZE) {
+    writer_flush(writer);
+  }
+  writer->buffer[writer->used++] = c;
+}
+
+void writer_puts(writer_t *writer, const char *s) {
+  writer_write(writer, s, strlen(s));
+}
+
+void writer_printf(writer_t *writer, const char *fmt, ...) {
+  char buffer[256];
+  va_list args;
+  int length;
+
+  va_start(args, fmt);
+  length = vsnprintf(buffer, sizeof(buffer), fmt, args);
+  va_end(args);
+
+  if (length < 0) {
+    return;
+  }
+  if ((size_t)length < sizeof(buffer)) {
+    writer_write(writer, buffer, length);
+    return;
+  }
+
+  /* too long for the local buffer, format again into a heap copy */
+  {
+    char *s = (char *)AK_MEM_MALLOC(length + 1);
+    va_start(args, fmt);
+    vsnprintf(s, length + 1, fmt, args);
+    va_end(args);
+    writer_write(writer, s, length);
+    AK_MEM_FREE(s);
+  }
+}
+
+void writer_flush(writer_t *writer) {
+  if (writer->used > 0) {
+    sink_write(writer->sink, writer->buffer, writer->used);
+    writer->used = 0;
+  }
+  sink_flush(writer->sink);
+}
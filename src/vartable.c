@@ -1,19 +1,20 @@
 #include <stdlib.h>
-#include <string.h>
 #include "vartable.h"
 #include "utils/memory.h"
 #include "utils/array.h"
+#include "utils/symmap.h"
 
 struct varentry_t {
-  int   offset;
-  bool  is_local;
-  char *name;
+  int       offset;
+  bool      is_local;
+  symbol_t  name;
 };
 
 struct vartable_t {
   vartable_t *parent;
   int         offset;
   array_t    *vars;
+  symmap_t   *index;
 };
 
 vartable_t *vartable_new(vartable_t *parent) {
@@ -21,6 +22,7 @@ vartable_t *vartable_new(vartable_t *parent) {
   vartable->parent = parent;
   vartable->offset = 0;
   vartable->vars = array_new(64);
+  vartable->index = symmap_new(64);
   return vartable;
 }
 
@@ -29,10 +31,10 @@ void vartable_release(vartable_t **pvartable) {
 
   for (int i = 0; i < array_count(vt->vars); ++i) {
     varentry_t *e = (varentry_t *)array_get(vt->vars, i);
-    AK_MEM_FREE(e->name);
     AK_MEM_FREE(e);
   }
   array_release(&vt->vars);
+  symmap_release(&vt->index);
 
   AK_MEM_FREE(vt);
 
@@ -43,33 +45,28 @@ vartable_t *vartable_get_parent(vartable_t *vartable) {
   return vartable->parent;
 }
 
-static varentry_t *lookup(vartable_t *vartable, const char *name) {
-  for (int i = 0; i < array_count(vartable->vars); ++i) {
-    varentry_t *entry = (varentry_t *)array_get(vartable->vars, i);
-    if (strcmp(entry->name, name) == 0) {
-      return entry;
-    }
-  }
-  return NULL;
+static varentry_t *lookup(vartable_t *vartable, symbol_t name) {
+  return (varentry_t *)symmap_get(vartable->index, name);
 }
 
-varentry_t *vartable_add_var(vartable_t *vartable, const char *name, int size) {
+varentry_t *vartable_add_var(vartable_t *vartable, symbol_t name, int size) {
   varentry_t *entry = lookup(vartable, name);
 
   if (!entry) {
     entry = (varentry_t *)AK_MEM_MALLOC(sizeof(varentry_t));
     entry->offset = vartable->offset;
     entry->is_local = vartable->parent != NULL;
-    entry->name = AK_MEM_STRDUP(name);
+    entry->name = name;
 
     array_append(vartable->vars, entry);
+    symmap_put(vartable->index, name, entry);
     vartable->offset += size;
   }
 
   return entry;
 }
 
-varentry_t *vartable_lookup_or_add_var(vartable_t *vartable, const char *name) {
+varentry_t *vartable_lookup_or_add_var(vartable_t *vartable, symbol_t name) {
   varentry_t *entry = lookup(vartable, name);
 
   if (entry) {
@@ -92,5 +89,5 @@ bool varentry_is_local(varentry_t *e) {
 }
 
 const char *varentry_get_name(varentry_t *e) {
-  return e->name;
+  return symbol_get_name(e->name);
 }
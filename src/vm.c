@@ -0,0 +1,503 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "vm.h"
+#include "inst.h"
+#include "utils/memory.h"
+
+/*
+ * Bytecode is dispatched by computed goto (direct threading) on GCC compatible
+ * compilers. Define AK_VM_SWITCH_DISPATCH to force the portable switch loop.
+ */
+#if defined(__GNUC__) && !defined(AK_VM_SWITCH_DISPATCH)
+#define VM_THREADED
+#endif
+
+#define INITIAL_STACK_CAPACITY ( 1024 )
+#define INITIAL_HEAP_CAPACITY  ( 1024 )
+#define INITIAL_CALL_CAPACITY  ( 256 )
+#define HEAP_ADDRESS_MAX       ( 1 << 26 )
+#define CALL_DEPTH_MAX         ( 1 << 24 )
+
+/*
+ * A bytecode cell. Each instruction occupies one cell holding its opcode (or
+ * its handler address once threaded), followed by one operand cell for
+ * PUSH/COPY/SLIDE and for control transfers, whose target is a direct pointer
+ * into the code.
+ */
+typedef union cell_t cell_t;
+union cell_t {
+  const void *handler;
+  opcode_t    opcode;
+  int64_t     value;
+  cell_t     *target;
+};
+
+struct vm_t {
+  cell_t   *code;
+  int       code_size;
+  bool      threaded;
+  int64_t  *stack;
+  int       stack_capacity;
+  int64_t  *heap;
+  int       heap_capacity;
+  cell_t  **calls;
+  int       call_capacity;
+  int       error_count;
+};
+
+static void     lower(vm_t *vm, insts_t *instructions);
+static int      operand_count(opcode_t opcode);
+static int64_t *grow_stack(vm_t *vm, int64_t *sp);
+static cell_t **grow_calls(vm_t *vm, cell_t **csp);
+static int64_t *heap_at(vm_t *vm, int64_t address);
+static int64_t  floor_div(int64_t x, int64_t y);
+static int64_t  floor_mod(int64_t x, int64_t y);
+static void     error(vm_t *vm, const char *fmt, ...);
+
+vm_t *vm_new(insts_t *instructions) {
+  vm_t *vm = (vm_t *)AK_MEM_MALLOC(sizeof(vm_t));
+  vm->threaded = false;
+  vm->stack_capacity = INITIAL_STACK_CAPACITY;
+  vm->stack = (int64_t *)AK_MEM_CALLOC(vm->stack_capacity, sizeof(int64_t));
+  vm->heap_capacity = INITIAL_HEAP_CAPACITY;
+  vm->heap = (int64_t *)AK_MEM_CALLOC(vm->heap_capacity, sizeof(int64_t));
+  vm->call_capacity = INITIAL_CALL_CAPACITY;
+  vm->calls = (cell_t **)AK_MEM_CALLOC(vm->call_capacity, sizeof(cell_t *));
+  vm->error_count = 0;
+  lower(vm, instructions);
+  return vm;
+}
+
+void vm_release(vm_t **pvm) {
+  vm_t *vm = *pvm;
+  AK_MEM_FREE(vm->code);
+  AK_MEM_FREE(vm->stack);
+  AK_MEM_FREE(vm->heap);
+  AK_MEM_FREE(vm->calls);
+  AK_MEM_FREE(vm);
+  *pvm = NULL;
+}
+
+int vm_get_error_count(vm_t *vm) {
+  return vm->error_count;
+}
+
+/*
+ * Lower the instruction array into dense bytecode. NOPs and labels take no
+ * space; a label resolves to the cell of the instruction following it.
+ * A trailing HALT stops programs running off the end.
+ */
+static void lower(vm_t *vm, insts_t *instructions) {
+  int count = insts_count(instructions);
+  int label_count = 0;
+  int *positions;
+  int pos = 0;
+
+  for (int i = 0; i < count; ++i) {
+    inst_t *inst = insts_get(instructions, i);
+    if (inst_has_label(inst) && inst->label >= label_count) {
+      label_count = inst->label + 1;
+    }
+  }
+
+  positions = (int *)AK_MEM_MALLOC(sizeof(int) * (label_count + 1));
+  for (int i = 0; i < label_count; ++i) {
+    positions[i] = -1;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    inst_t *inst = insts_get(instructions, i);
+    if (inst->opcode == OP_LABEL) {
+      positions[inst->label] = pos;
+    }
+    else if (inst->opcode != OP_NOP) {
+      pos += 1 + operand_count(inst->opcode);
+    }
+  }
+
+  vm->code_size = pos + 1;
+  vm->code = (cell_t *)AK_MEM_CALLOC(vm->code_size, sizeof(cell_t));
+  pos = 0;
+
+  for (int i = 0; i < count; ++i) {
+    inst_t *inst = insts_get(instructions, i);
+    int target;
+
+    switch (inst->opcode) {
+    case OP_NOP:
+    case OP_LABEL:
+      break;
+    case OP_PUSH:
+    case OP_COPY:
+    case OP_SLIDE:
+      vm->code[pos++].opcode = inst->opcode;
+      vm->code[pos++].value = inst->value;
+      break;
+    case OP_CALL:
+    case OP_JMP:
+    case OP_JZ:
+    case OP_JNEG:
+      target = positions[inst->label];
+      if (target < 0) {
+        error(vm, "error: undefined label L%d.\n", inst->label);
+        target = vm->code_size - 1;
+      }
+      vm->code[pos++].opcode = inst->opcode;
+      vm->code[pos++].target = &vm->code[target];
+      break;
+    default:
+      vm->code[pos++].opcode = inst->opcode;
+      break;
+    }
+  }
+
+  vm->code[pos].opcode = OP_HALT;
+
+  AK_MEM_FREE(positions);
+}
+
+static int operand_count(opcode_t opcode) {
+  switch (opcode) {
+  case OP_PUSH:
+  case OP_COPY:
+  case OP_SLIDE:
+  case OP_CALL:
+  case OP_JMP:
+  case OP_JZ:
+  case OP_JNEG:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+#ifdef VM_THREADED
+#define VM_HANDLER(OP) __extension__ &&L_##OP
+#define VM_CASE(OP)    L_##OP:
+#define VM_NEXT                                           \
+  do {                                                    \
+    _Pragma("GCC diagnostic push")                        \
+    _Pragma("GCC diagnostic ignored \"-Wpedantic\"")      \
+    goto *(pc++)->handler;                                \
+    _Pragma("GCC diagnostic pop")                         \
+  } while (0)
+#define VM_BEGIN       VM_NEXT;
+#define VM_END
+#else
+#define VM_CASE(OP)    case OP:
+#define VM_NEXT        continue
+#define VM_BEGIN       for (;;) { switch ((pc++)->opcode) {
+#define VM_END         } }
+#endif
+
+#define VM_NEED(N)                                        \
+  do {                                                    \
+    if (sp - vm->stack < (N)) {                           \
+      error(vm, "error: stack underflow.\n");             \
+      goto done;                                          \
+    }                                                     \
+  } while (0)
+
+#define VM_PUSH(X)                                        \
+  do {                                                    \
+    int64_t v_ = (X);                                     \
+    if (sp == stack_end) {                                \
+      sp = grow_stack(vm, sp);                            \
+      stack_end = vm->stack + vm->stack_capacity;         \
+    }                                                     \
+    *sp++ = v_;                                           \
+  } while (0)
+
+#define VM_CELL(ADDR, CELL)                               \
+  do {                                                    \
+    int64_t a_ = (ADDR);                                  \
+    if (a_ >= 0 && a_ < vm->heap_capacity) {              \
+      (CELL) = &vm->heap[a_];                             \
+    }                                                     \
+    else if (!((CELL) = heap_at(vm, a_))) {               \
+      goto done;                                          \
+    }                                                     \
+  } while (0)
+
+void vm_run(vm_t *vm) {
+  cell_t   *pc = vm->code;
+  int64_t  *sp = vm->stack;
+  int64_t  *stack_end = vm->stack + vm->stack_capacity;
+  cell_t  **csp = vm->calls;
+  int64_t   x, y;
+  int64_t  *cell;
+
+#ifdef VM_THREADED
+  static const void *handlers[] = {
+    [OP_NOP]   = VM_HANDLER(OP_NOP),
+    [OP_PUSH]  = VM_HANDLER(OP_PUSH),
+    [OP_COPY]  = VM_HANDLER(OP_COPY),
+    [OP_SLIDE] = VM_HANDLER(OP_SLIDE),
+    [OP_DUP]   = VM_HANDLER(OP_DUP),
+    [OP_POP]   = VM_HANDLER(OP_POP),
+    [OP_SWAP]  = VM_HANDLER(OP_SWAP),
+    [OP_ADD]   = VM_HANDLER(OP_ADD),
+    [OP_SUB]   = VM_HANDLER(OP_SUB),
+    [OP_MUL]   = VM_HANDLER(OP_MUL),
+    [OP_DIV]   = VM_HANDLER(OP_DIV),
+    [OP_MOD]   = VM_HANDLER(OP_MOD),
+    [OP_STORE] = VM_HANDLER(OP_STORE),
+    [OP_LOAD]  = VM_HANDLER(OP_LOAD),
+    [OP_PUTC]  = VM_HANDLER(OP_PUTC),
+    [OP_PUTI]  = VM_HANDLER(OP_PUTI),
+    [OP_GETC]  = VM_HANDLER(OP_GETC),
+    [OP_GETI]  = VM_HANDLER(OP_GETI),
+    [OP_LABEL] = VM_HANDLER(OP_LABEL),
+    [OP_CALL]  = VM_HANDLER(OP_CALL),
+    [OP_JMP]   = VM_HANDLER(OP_JMP),
+    [OP_JZ]    = VM_HANDLER(OP_JZ),
+    [OP_JNEG]  = VM_HANDLER(OP_JNEG),
+    [OP_RET]   = VM_HANDLER(OP_RET),
+    [OP_HALT]  = VM_HANDLER(OP_HALT)
+  };
+
+  /* replace each opcode by the address of its handler */
+  if (!vm->threaded) {
+    for (int i = 0; i < vm->code_size; ) {
+      opcode_t opcode = vm->code[i].opcode;
+      vm->code[i].handler = handlers[opcode];
+      i += 1 + operand_count(opcode);
+    }
+    vm->threaded = true;
+  }
+#endif
+
+  if (vm->error_count > 0) {
+    return;
+  }
+
+  VM_BEGIN
+
+  VM_CASE(OP_NOP)
+    VM_NEXT;
+
+  VM_CASE(OP_PUSH)
+    VM_PUSH((pc++)->value);
+    VM_NEXT;
+
+  VM_CASE(OP_COPY)
+    x = (pc++)->value;
+    if (x < 0 || sp - vm->stack <= x) {
+      error(vm, "error: stack underflow on COPY %" PRId64 ".\n", x);
+      goto done;
+    }
+    VM_PUSH(sp[-1 - x]);
+    VM_NEXT;
+
+  VM_CASE(OP_SLIDE)
+    x = (pc++)->value;
+    if (x < 0 || sp - vm->stack <= x) {
+      error(vm, "error: stack underflow on SLIDE %" PRId64 ".\n", x);
+      goto done;
+    }
+    sp[-1 - x] = sp[-1];
+    sp -= x;
+    VM_NEXT;
+
+  VM_CASE(OP_DUP)
+    VM_NEED(1);
+    VM_PUSH(sp[-1]);
+    VM_NEXT;
+
+  VM_CASE(OP_POP)
+    VM_NEED(1);
+    --sp;
+    VM_NEXT;
+
+  VM_CASE(OP_SWAP)
+    VM_NEED(2);
+    x = sp[-2];
+    sp[-2] = sp[-1];
+    sp[-1] = x;
+    VM_NEXT;
+
+  VM_CASE(OP_ADD)
+    VM_NEED(2);
+    --sp;
+    sp[-1] += sp[0];
+    VM_NEXT;
+
+  VM_CASE(OP_SUB)
+    VM_NEED(2);
+    --sp;
+    sp[-1] -= sp[0];
+    VM_NEXT;
+
+  VM_CASE(OP_MUL)
+    VM_NEED(2);
+    --sp;
+    sp[-1] *= sp[0];
+    VM_NEXT;
+
+  VM_CASE(OP_DIV)
+    VM_NEED(2);
+    if ((y = *--sp) == 0) {
+      error(vm, "error: division by zero.\n");
+      goto done;
+    }
+    sp[-1] = floor_div(sp[-1], y);
+    VM_NEXT;
+
+  VM_CASE(OP_MOD)
+    VM_NEED(2);
+    if ((y = *--sp) == 0) {
+      error(vm, "error: division by zero.\n");
+      goto done;
+    }
+    sp[-1] = floor_mod(sp[-1], y);
+    VM_NEXT;
+
+  VM_CASE(OP_STORE)
+    VM_NEED(2);
+    sp -= 2;
+    VM_CELL(sp[0], cell);
+    *cell = sp[1];
+    VM_NEXT;
+
+  VM_CASE(OP_LOAD)
+    VM_NEED(1);
+    VM_CELL(sp[-1], cell);
+    sp[-1] = *cell;
+    VM_NEXT;
+
+  VM_CASE(OP_PUTC)
+    VM_NEED(1);
+    putchar((int)*--sp);
+    VM_NEXT;
+
+  VM_CASE(OP_PUTI)
+    VM_NEED(1);
+    printf("%" PRId64, *--sp);
+    VM_NEXT;
+
+  VM_CASE(OP_GETC)
+    VM_NEED(1);
+    VM_CELL(*--sp, cell);
+    fflush(stdout);
+    *cell = getchar();
+    VM_NEXT;
+
+  VM_CASE(OP_GETI)
+    VM_NEED(1);
+    VM_CELL(*--sp, cell);
+    fflush(stdout);
+    if (scanf("%" SCNd64, cell) != 1) {
+      error(vm, "error: failed to read an integer.\n");
+      goto done;
+    }
+    VM_NEXT;
+
+  VM_CASE(OP_LABEL)
+    VM_NEXT;
+
+  VM_CASE(OP_CALL)
+    if (csp == vm->calls + vm->call_capacity && !(csp = grow_calls(vm, csp))) {
+      goto done;
+    }
+    *csp++ = pc + 1;
+    pc = pc->target;
+    VM_NEXT;
+
+  VM_CASE(OP_JMP)
+    pc = pc->target;
+    VM_NEXT;
+
+  VM_CASE(OP_JZ)
+    VM_NEED(1);
+    pc = *--sp == 0 ? pc->target : pc + 1;
+    VM_NEXT;
+
+  VM_CASE(OP_JNEG)
+    VM_NEED(1);
+    pc = *--sp < 0 ? pc->target : pc + 1;
+    VM_NEXT;
+
+  VM_CASE(OP_RET)
+    if (csp == vm->calls) {
+      error(vm, "error: return with empty call stack.\n");
+      goto done;
+    }
+    pc = *--csp;
+    VM_NEXT;
+
+  VM_CASE(OP_HALT)
+    goto done;
+
+  VM_END
+
+done:
+  fflush(stdout);
+}
+
+static int64_t *grow_stack(vm_t *vm, int64_t *sp) {
+  int depth = (int)(sp - vm->stack);
+  vm->stack_capacity *= 2;
+  vm->stack = (int64_t *)AK_MEM_REALLOC(vm->stack, sizeof(int64_t) * vm->stack_capacity);
+  return vm->stack + depth;
+}
+
+static cell_t **grow_calls(vm_t *vm, cell_t **csp) {
+  int depth = (int)(csp - vm->calls);
+  if (vm->call_capacity >= CALL_DEPTH_MAX) {
+    error(vm, "error: call stack overflow.\n");
+    return NULL;
+  }
+  vm->call_capacity *= 2;
+  vm->calls = (cell_t **)AK_MEM_REALLOC(vm->calls, sizeof(cell_t *) * vm->call_capacity);
+  return vm->calls + depth;
+}
+
+static int64_t *heap_at(vm_t *vm, int64_t address) {
+  if (address < 0 || address >= HEAP_ADDRESS_MAX) {
+    error(vm, "error: invalid heap address %" PRId64 ".\n", address);
+    return NULL;
+  }
+
+  if (address >= vm->heap_capacity) {
+    int capacity = vm->heap_capacity;
+    while (address >= capacity) {
+      capacity *= 2;
+    }
+    vm->heap = (int64_t *)AK_MEM_REALLOC(vm->heap, sizeof(int64_t) * capacity);
+    for (int i = vm->heap_capacity; i < capacity; ++i) {
+      vm->heap[i] = 0;
+    }
+    vm->heap_capacity = capacity;
+  }
+
+  return &vm->heap[address];
+}
+
+/* division and modulo round toward negative infinity as in the reference interpreter. */
+static int64_t floor_div(int64_t x, int64_t y) {
+  int64_t q = x / y;
+  if (x % y != 0 && (x < 0) != (y < 0)) {
+    --q;
+  }
+  return q;
+}
+
+static int64_t floor_mod(int64_t x, int64_t y) {
+  int64_t r = x % y;
+  if (r != 0 && (r < 0) != (y < 0)) {
+    r += y;
+  }
+  return r;
+}
+
+static void error(vm_t *vm, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  vm->error_count++;
+}